@@ -0,0 +1,261 @@
+/**
+ * @file batch.c - Batched sending and receiving of messages.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE /* sendmmsg(), recvmmsg() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_BATCH
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "batch.h"
+
+/**
+ * Initialize batch for given number of messages.
+ *
+ * @param b Pointer to the batch.
+ * @param size Maximum number of messages on the batch.
+ * @param buf_len Size of the data buffer allocated for each message, 0 if
+ * the batch should point to the data of the caller.
+ * @return -1 if the size is invalid, 0 on success.
+ */
+int batch_init( struct mmsg_batch *b, unsigned int size, size_t buf_len )
+{
+        memset( b, 0, sizeof(*b));
+        if ( size == 0 || size > BATCH_MAX ) 
+                return -1;
+
+        b->size = size;
+        b->buf_len = buf_len;
+        b->msgs = mem_zalloc( size * sizeof(*b->msgs));
+        b->iov = mem_zalloc( size * sizeof(*b->iov));
+        b->addrs = mem_zalloc( size * sizeof(*b->addrs));
+        b->cbuf = mem_zalloc( size * SCTP_CMSG_SPACE );
+        if ( buf_len > 0 ) 
+                b->bufs = mem_alloc( size * buf_len );
+
+        TRACE("Batch of %u messages (%zu bytes each)\n", size, buf_len );
+        return 0;
+}
+
+/**
+ * Release the memory allocated for the batch.
+ *
+ * @param b Pointer to the batch.
+ */
+void batch_free( struct mmsg_batch *b )
+{
+        if ( b->msgs == NULL )
+                return;
+
+        mem_free( b->msgs );
+        mem_free( b->iov );
+        mem_free( b->addrs );
+        mem_free( b->cbuf );
+        if ( b->bufs != NULL )
+                mem_free( b->bufs );
+        memset( b, 0, sizeof(*b));
+}
+
+/**
+ * Add message to the batch of messages to send.
+ *
+ * @param b Pointer to the batch.
+ * @param dst Destination for the message, NULL if the socket is connected.
+ * @param dst_len Length of the destination address.
+ * @param data The data to send.
+ * @param len Number of bytes to send.
+ * @param ppid PPID for the message.
+ * @param streamno Stream to send the message to.
+ * @param context Context of the message, reported back if sending fails.
+ * @return -1 if the batch is full or the data does not fit to the buffer
+ * of the batch, 0 on success.
+ */
+int batch_add( struct mmsg_batch *b, struct sockaddr *dst, socklen_t dst_len,
+                uint8_t *data, size_t len, uint32_t ppid, uint16_t streamno,
+                uint32_t context )
+{
+        struct msghdr *msg;
+        unsigned int i;
+
+        if ( BATCH_FULL(b) || (b->bufs != NULL && len > b->buf_len))
+                return -1;
+
+        i = b->count++;
+        msg = &b->msgs[i].msg_hdr;
+        memset( msg, 0, sizeof(*msg));
+
+        if ( b->bufs != NULL ) {
+                memcpy( b->bufs + i * b->buf_len, data, len );
+                data = b->bufs + i * b->buf_len;
+        }
+        b->iov[i].iov_base = data;
+        b->iov[i].iov_len = len;
+        msg->msg_iov = &b->iov[i];
+        msg->msg_iovlen = 1;
+
+        if ( dst != NULL ) {
+                memcpy( &b->addrs[i], dst, dst_len );
+                msg->msg_name = &b->addrs[i];
+                msg->msg_namelen = dst_len;
+        }
+
+        set_sndinfo_cmsg( msg, b->cbuf + i * SCTP_CMSG_SPACE, ppid, streamno,
+                        context );
+
+        return 0;
+}
+
+/**
+ * Send all the messages queued on the batch. 
+ *
+ * If sending fails after some messages have been sent, the rest of the
+ * messages are dropped.
+ *
+ * @param sock The socket to send the messages to.
+ * @param b Pointer to the batch.
+ * @return Number of messages sent, -1 if no messages could be sent.
+ */
+int batch_flush( int sock, struct mmsg_batch *b )
+{
+        unsigned int sent = 0;
+        int ret;
+
+        while ( sent < b->count ) {
+                ret = sendmmsg( sock, b->msgs + sent, b->count - sent, 0 );
+                if ( ret < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+                        if ( sent == 0 ) {
+                                b->count = 0;
+                                return -1;
+                        }
+                        WARN("Dropped %u messages : %s\n", b->count - sent,
+                                        strerror(errno));
+                        break;
+                }
+                sent += ret;
+        }
+        TRACE("Sent %u / %u messages \n", sent, b->count );
+        b->count = 0;
+        return sent;
+}
+
+/**
+ * Receive available messages to the batch without blocking.
+ *
+ * The batch should have been created with buffers for the data.
+ *
+ * @param sock The socket to read.
+ * @param b Pointer to the batch.
+ * @return Number of messages received, 0 if there was no messages to
+ * receive, -1 on error.
+ */
+int batch_recv( int sock, struct mmsg_batch *b )
+{
+        struct msghdr *msg;
+        unsigned int i;
+        int ret;
+
+        ASSERT( b->bufs != NULL );
+        for ( i = 0; i < b->size; i++ ) {
+                msg = &b->msgs[i].msg_hdr;
+                b->iov[i].iov_base = b->bufs + i * b->buf_len;
+                b->iov[i].iov_len = b->buf_len;
+                msg->msg_iov = &b->iov[i];
+                msg->msg_iovlen = 1;
+                msg->msg_name = &b->addrs[i];
+                msg->msg_namelen = sizeof(b->addrs[i]);
+                msg->msg_control = b->cbuf + i * SCTP_CMSG_SPACE;
+                msg->msg_controllen = SCTP_CMSG_SPACE;
+                msg->msg_flags = 0;
+        }
+
+        b->count = 0;
+        ret = recvmmsg( sock, b->msgs, b->size, MSG_DONTWAIT, NULL );
+        if ( ret < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                        return 0;
+                return -1;
+        }
+        TRACE("Received %d messages\n", ret );
+        b->count = ret;
+        return ret;
+}
+
+/**
+ * Get the data of received message.
+ *
+ * @param b Pointer to the batch.
+ * @param i Index of the message.
+ * @param len Pointer where the number of bytes received is written.
+ * @param flags Pointer where the flags of the message are written.
+ * @param peerlen Pointer where the length of the peer address (in
+ * b->addrs[i]) is written.
+ * @return Pointer to the received data.
+ */
+uint8_t *batch_data( struct mmsg_batch *b, unsigned int i, size_t *len, 
+                int *flags, socklen_t *peerlen )
+{
+        *len = b->msgs[i].msg_len;
+        *flags = b->msgs[i].msg_hdr.msg_flags;
+        *peerlen = b->msgs[i].msg_hdr.msg_namelen;
+        return b->iov[i].iov_base;
+}
+
+/**
+ * Get the SCTP information of received message.
+ *
+ * @param b Pointer to the batch.
+ * @param i Index of the message.
+ * @param info Pointer to the structure to fill.
+ */
+void batch_rcvinfo( struct mmsg_batch *b, unsigned int i, 
+                struct sctp_sndrcvinfo *info )
+{
+        struct msghdr *msg;
+        struct cmsghdr *cmsg;
+
+        memset( info, 0, sizeof(*info));
+        msg = &b->msgs[i].msg_hdr;
+        for ( cmsg = CMSG_FIRSTHDR( msg ); cmsg != NULL; 
+                        cmsg = CMSG_NXTHDR( msg, cmsg )) 
+                get_rcvinfo_cmsg( cmsg, info );
+}
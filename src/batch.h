@@ -0,0 +1,78 @@
+/**
+ * @file batch.h - Batched sending and receiving of messages.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/**
+ * Maximum number of messages on one batch (UIO_MAXIOV).
+ */
+#define BATCH_MAX 1024
+
+/**
+ * Batch of messages to send with one sendmmsg() or to receive with one
+ * recvmmsg() call.
+ *
+ * Each message carries its own SCTP_SNDINFO (when sending) or SCTP_RCVINFO
+ * (when receiving) control message. If the batch is created with buffers,
+ * the data is copied to the batch when messages are added, otherwise the
+ * batch only points to the data of the caller.
+ */
+struct mmsg_batch {
+        unsigned int size; /**< Maximum number of messages on batch */
+        unsigned int count; /**< Number of messages queued or received */
+        size_t buf_len; /**< Size of the buffer for each message, 0 for none */
+        struct mmsghdr *msgs; /**< Message headers */
+        struct iovec *iov; /**< One iovec for each message */
+        struct sockaddr_storage *addrs; /**< Peer address for each message */
+        uint8_t *cbuf; /**< Control message buffer for each message */
+        uint8_t *bufs; /**< Data buffer for each message, if any */
+};
+
+int batch_init( struct mmsg_batch *b, unsigned int size, size_t buf_len );
+void batch_free( struct mmsg_batch *b );
+int batch_add( struct mmsg_batch *b, struct sockaddr *dst, socklen_t dst_len,
+                uint8_t *data, size_t len, uint32_t ppid, uint16_t streamno,
+                uint32_t context );
+int batch_flush( int sock, struct mmsg_batch *b );
+int batch_recv( int sock, struct mmsg_batch *b );
+uint8_t *batch_data( struct mmsg_batch *b, unsigned int i, size_t *len, 
+                int *flags, socklen_t *peerlen );
+void batch_rcvinfo( struct mmsg_batch *b, unsigned int i, 
+                struct sctp_sndrcvinfo *info );
+
+/**
+ * Check if the batch is full, with no room for more messages.
+ */
+#define BATCH_FULL(b) ((b)->count == (b)->size)
+
+#endif /* _BATCH_H_ */
@@ -30,6 +30,7 @@
  * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE /* sched_setaffinity() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
@@ -42,10 +43,13 @@
 #include <netinet/sctp.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
-#include <limits.h> /* LONG_MAX, LONG_MIN */
+#include <limits.h> /* LONG_MAX, LONG_MIN, ULLONG_MAX */
 #include <netdb.h>
+#include <time.h>
 
 #define DBG_MODULE_NAME DBG_MODULE_COMMON
 
@@ -53,6 +57,8 @@
 #include "debug.h"
 #include "common.h"
 #include "sctp_auth.h"
+#include "batch.h"
+#include "outlog.h"
 
 
 /** 
@@ -110,6 +116,94 @@ int resolve( char *addr, struct sockaddr_storage *ss )
         return 0;
 }
 
+/**
+ * Resolve given address and add it to the address set.
+ *
+ * @param set The address set.
+ * @param addr The address string.
+ * @return -1 if the address is invalid or the set is full, 0 on success.
+ */
+int addr_set_add( struct addr_set *set, char *addr )
+{
+        if ( set->count >= MAX_ADDRS || resolve( addr, &set->addrs[set->count] ) < 0 ) 
+                return -1;
+
+        set->count++;
+        return 0;
+}
+
+/**
+ * Pack the addresses of the set with given port to the array format
+ * sctp_bindx() and sctp_connectx() expect.
+ *
+ * @param set The address set.
+ * @param port The port to set to the addresses.
+ * @param buf Buffer for the packed addresses, should have room for
+ * MAX_ADDRS IPv6 addresses.
+ */
+static void addr_set_pack( struct addr_set *set, uint16_t port, uint8_t *buf )
+{
+        struct sockaddr_in *sin;
+        struct sockaddr_in6 *sin6;
+        int i;
+
+        for ( i = 0; i < set->count; i++ ) {
+                if ( set->addrs[i].ss_family == AF_INET ) {
+                        sin = (struct sockaddr_in *)buf;
+                        memcpy( sin, &set->addrs[i], sizeof(*sin));
+                        sin->sin_port = htons(port);
+                        buf += sizeof(*sin);
+                } else {
+                        sin6 = (struct sockaddr_in6 *)buf;
+                        memcpy( sin6, &set->addrs[i], sizeof(*sin6));
+                        sin6->sin6_port = htons(port);
+                        buf += sizeof(*sin6);
+                }
+        }
+}
+
+/**
+ * Bind the socket to all addresses of the set.
+ *
+ * @param sock The socket to bind.
+ * @param set The local addresses.
+ * @param port Local port to bind to, 0 for any.
+ * @return -1 on error, 0 on success.
+ */
+int common_bindx( int sock, struct addr_set *set, uint16_t port )
+{
+        uint8_t buf[MAX_ADDRS * sizeof(struct sockaddr_in6)];
+
+        DBG("Binding to %d local addresses\n", set->count);
+        addr_set_pack( set, port, buf );
+        if ( sctp_bindx( sock, (struct sockaddr *)buf, set->count, 
+                                SCTP_BINDX_ADD_ADDR ) < 0 ) {
+                print_error("Unable to bind to the local addresses", errno);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Connect to the peer using all addresses of the set.
+ *
+ * Like with connect() on non-blocking socket, -1 is returned with errno
+ * set to EINPROGRESS if the association set up is still in progress.
+ *
+ * @param sock The socket to connect.
+ * @param set The addresses of the peer.
+ * @param port The port of the peer.
+ * @return -1 on error, 0 on success.
+ */
+int common_connectx( int sock, struct addr_set *set, uint16_t port )
+{
+        uint8_t buf[MAX_ADDRS * sizeof(struct sockaddr_in6)];
+
+        DBG("Connecting to %d peer addresses\n", set->count);
+        addr_set_pack( set, port, buf );
+        return sctp_connectx( sock, (struct sockaddr *)buf, set->count, NULL );
+}
+
 /** 
  * @brief Parse uint16 number from given string.
  *
@@ -162,6 +256,96 @@ int parse_uint32(char *str, uint32_t *dst )
         return 0;
 }
 
+/**
+ * Get the current time from the monotonic clock.
+ *
+ * @return Current time in nanoseconds.
+ */
+uint64_t time_now_ns( void )
+{
+        struct timespec ts;
+
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/** 
+ * @brief Parse rate from given string.
+ *
+ * The number may be followed by k, M or G suffix to multiply it with 1000,
+ * 1000000 or 1000000000 respectively.
+ * 
+ * @param str String containing the rate.
+ * @param dst Pointer where the parsed rate should be saved.
+ * 
+ * @return 0 if parsing succeeded, -1 if there was error.
+ */
+int parse_rate( char *str, uint64_t *dst )
+{
+        unsigned long long ret, mult;
+        char *end;
+
+        errno = 0;
+        ret = strtoull( str, &end, 10 );
+        if ( errno != 0 || end == str || *str == '-' )
+                return -1;
+
+        switch ( *end ) {
+                case '\0' :
+                        mult = 1;
+                        break;
+                case 'k' :
+                case 'K' :
+                        mult = 1000ULL;
+                        end++;
+                        break;
+                case 'M' :
+                        mult = 1000000ULL;
+                        end++;
+                        break;
+                case 'G' :
+                        mult = 1000000000ULL;
+                        end++;
+                        break;
+                default :
+                        return -1;
+        }
+        if ( ret > ULLONG_MAX / mult )
+                return -1;
+        ret *= mult;
+        if ( *end != '\0' )
+                return -1;
+
+        *dst = ret;
+        return 0;
+}
+
+/** 
+ * @brief Parse time interval in seconds from given string.
+ *
+ * The interval may have fractional part (e.g. 0.5).
+ * 
+ * @param str String containing the interval.
+ * @param dst Pointer where the parsed interval, in nanoseconds, should be
+ * saved.
+ * 
+ * @return 0 if parsing succeeded, -1 if there was error.
+ */
+int parse_interval( char *str, uint64_t *dst )
+{
+        double ret;
+        char *end;
+
+        errno = 0;
+        ret = strtod( str, &end );
+        if ( errno != 0 || end == str || *end != '\0' || 
+                        ret < 0.001 || ret > 86400.0 )
+                return -1;
+
+        *dst = (uint64_t)(ret * NSEC_PER_SEC);
+        return 0;
+}
+
 /** 
  * Set the given set of flags on.
  *
@@ -205,46 +389,122 @@ flags_t unset_flag( flags_t flags, flags_t set )
 }
 
 
+/**
+ * Delivery options for all the messages sent, set from the common context
+ * when the socket is created.
+ */
+static struct send_policy send_policy;
+
+/**
+ * SCTP_SNDINFO control message of the last message sent by sendit(). 
+ *
+ * Consecutive messages are usually sent with same PPID and stream, so the
+ * control message is built only when they change, only the context is
+ * updated for each message. The cache is per thread, as the server 
+ * workers may send concurrently.
+ */
+struct sndinfo_cache {
+        int valid; /**< 1 if the control message has been built */
+        uint32_t ppid; /**< PPID of the control message */
+        uint16_t streamno; /**< Stream of the control message */
+        uint8_t cbuf[SCTP_CMSG_SPACE]; /**< The control message */
+        size_t clen; /**< Length of the control message */
+        struct sctp_sndinfo *sinfo; /**< The SCTP_SNDINFO within cbuf */
+};
+
+static __thread struct sndinfo_cache sndinfo_cache;
+
 /** 
- * @brief Send data using SEQPKT socket. 
+ * @brief Send data using SCTP socket. 
  *
- * The data is sent and PPID and Stream ID are set as requested.
+ * The data is sent and PPID and Stream ID are set as requested. The
+ * SCTP_SNDINFO control message is reused from previous send if PPID and
+ * Stream ID have not changed.
  * 
  * @param sock The socket to use when sending.
  * @param ppid  PPID for the SCTP chunk
  * @param streamno The stream no for the stream where the data is to be written.
- * @param dst Destination host
+ * @param context Context of the message, reported back if sending fails.
+ * @param dst Destination host, NULL if the socket is connected.
  * @param dst_len Length of the sockaddr structure.
  * @param chunk The data to send.
  * @param chunk_size  Number of bytes to send.
  * 
  * @return Number of bytes sent on success <0 on error.
  */
-int sendit( int sock, uint32_t ppid, uint16_t streamno,
+int sendit( int sock, uint32_t ppid, uint16_t streamno, uint32_t context,
                 struct sockaddr *dst, size_t dst_len,
                 uint8_t *chunk, int chunk_size )
 {
+        struct iovec iov;
         int ret;
 
-        TRACE("Sending with ppid %d and stream no %d\n", ppid, streamno);
-
-        ret = sctp_sendmsg( sock, chunk, chunk_size, 
-                        dst, dst_len,
-                        ppid, /* ppid */
-                        0, /* flags */
-                        streamno, /* stream no */
-                        0, /* ttl */
-                        0xF00F /* context */
-                        );
+        iov.iov_base = chunk;
+        iov.iov_len = chunk_size;
+        ret = sendit_iov( sock, ppid, streamno, context, dst, dst_len, 
+                        &iov, 1, 0 );
         TRACE( "Sent %d / %d bytes \n", ret, chunk_size );
         return ret;
 }
 
+/** 
+ * @brief Send data gathered from multiple buffers using SCTP socket. 
+ *
+ * Same as sendit(), but the data is taken from the given iovecs. If
+ * SCTP_EXPLICIT_EOR is enabled on the socket, the message is completed
+ * only when MSG_EOR is given on flags.
+ * 
+ * @param sock The socket to use when sending.
+ * @param ppid  PPID for the SCTP chunk
+ * @param streamno The stream no for the stream where the data is to be written.
+ * @param context Context of the message, reported back if sending fails.
+ * @param dst Destination host, NULL if the socket is connected.
+ * @param dst_len Length of the sockaddr structure.
+ * @param iov The data to send.
+ * @param iovcnt Number of iovecs.
+ * @param flags Flags for sendmsg().
+ * 
+ * @return Number of bytes sent on success <0 on error.
+ */
+ssize_t sendit_iov( int sock, uint32_t ppid, uint16_t streamno, 
+                uint32_t context, struct sockaddr *dst, size_t dst_len,
+                struct iovec *iov, int iovcnt, int flags )
+{
+        struct sndinfo_cache *cache = &sndinfo_cache;
+        struct msghdr msg;
+
+        TRACE("Sending with ppid %d and stream no %d\n", ppid, streamno);
+
+        memset( &msg, 0, sizeof(msg));
+        if ( !cache->valid || cache->ppid != ppid || 
+                        cache->streamno != streamno ) {
+                set_sndinfo_cmsg( &msg, cache->cbuf, ppid, streamno, context );
+                cache->clen = msg.msg_controllen;
+                cache->sinfo = (struct sctp_sndinfo *)CMSG_DATA(CMSG_FIRSTHDR(&msg));
+                cache->ppid = ppid;
+                cache->streamno = streamno;
+                cache->valid = 1;
+        }
+        cache->sinfo->snd_context = context;
+        msg.msg_control = cache->cbuf;
+        msg.msg_controllen = cache->clen;
+
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        if ( dst != NULL ) {
+                msg.msg_name = dst;
+                msg.msg_namelen = dst_len;
+        }
+
+        return sendmsg( sock, &msg, flags );
+}
+
 /** 
  * @brief Wait for incoming data and read it if it becomes available. 
  *
  * If the peer is non-null, then it is assumed that the socket is in
- * SEQPKT state.
+ * SEQPKT state. The data is read first without waiting, select() is
+ * called only if there is no data pending.
  * 
  * @param sock Socket to use
  * @param timeout_ms Number of milliseconds to wait for incoming data.
@@ -264,13 +524,29 @@ int recv_wait( int sock, time_t timeout_ms, uint8_t *chunk, size_t chunk_len,
 {
         fd_set fds;
         struct timeval tv;
+        socklen_t len = peerlen != NULL ? *peerlen : 0;
+        int in_flags = *flags;
         int ret;
 
+        *flags = in_flags | MSG_DONTWAIT;
+        ret = sctp_recvmsg( sock, chunk, chunk_len, peer, peerlen, info, flags );
+        if ( ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if ( peerlen != NULL )
+                        *peerlen = len;
+                *flags = in_flags;
+        } else {
+                TRACE("Received %d bytes of chunk (size %d ) \n", ret, chunk_len );
+                if ( ret < 0 )
+                        return errno == ECONNRESET ? -2 : -1;
+                return ret == 0 ? -2 : ret;
+        }
+
         FD_ZERO( &fds );
         FD_SET( sock, &fds );
         memset( &tv, 0, sizeof( tv ));
 
-        tv.tv_usec = timeout_ms * 1000;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
 
         ret = select( sock+1, &fds, NULL, NULL, &tv );
         if ( ret < 0 ) {
@@ -297,6 +573,135 @@ int recv_wait( int sock, time_t timeout_ms, uint8_t *chunk, size_t chunk_len,
 
         return ret;
 }
+/** 
+ * @brief Read data, spinning on non-blocking reads until it is available. 
+ *
+ * This is the busy poll variant of recv_wait(), the CPU is kept busy
+ * instead of sleeping to avoid the wakeup latency.
+ * 
+ * @param sock Socket to use
+ * @param timeout_ms Number of milliseconds to wait for incoming data.
+ * @param chunk Pointer to the buffer where received data is read.
+ * @param chunk_len Maximum number of bytes to read.
+ * @param peer  Sockaddr where the peers address is to be set.
+ * @param peerlen Size of the address structure.
+ * @param info  Pointer for the structure where the additional SCTP information is to be saved.
+ * @param flags Pointer where the receiving flags should be written.
+ * 
+ * @return  Number of bytes read on success, 0 on timeout and -1 on error, -2 if the 
+ * remote end has shut down.
+ */
+int recv_spin( int sock, time_t timeout_ms, uint8_t *chunk, size_t chunk_len,
+                struct sockaddr *peer, socklen_t *peerlen,
+                struct sctp_sndrcvinfo *info, int *flags )
+{
+        uint64_t until = time_now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+        socklen_t len = peerlen != NULL ? *peerlen : 0;
+        int in_flags = *flags;
+        int ret;
+
+        do {
+                if ( peerlen != NULL )
+                        *peerlen = len;
+                *flags = in_flags | MSG_DONTWAIT;
+                ret = sctp_recvmsg( sock, chunk, chunk_len, peer, peerlen, 
+                                info, flags );
+                if ( ret > 0 )
+                        return ret;
+                else if ( ret == 0 || errno == ECONNRESET )
+                        return -2;
+                else if ( errno != EAGAIN && errno != EWOULDBLOCK )
+                        return -1;
+        } while ( time_now_ns() < until );
+
+        return 0;
+}
+
+/**
+ * Set SCTP_SNDINFO control message for message to send.
+ *
+ * The delivery options of the send policy are applied: the unordered flag
+ * is set on SCTP_SNDINFO and, for partially reliable delivery, SCTP_PRINFO
+ * is added. SCTP_SNDINFO overrides the SCTP_DEFAULT_PRINFO of the socket,
+ * so the policy has to be given with each message.
+ *
+ * @param msg The message, msg_control and msg_controllen are set.
+ * @param cbuf Buffer for the control message, at least SCTP_CMSG_SPACE
+ * bytes.
+ * @param ppid PPID for the message.
+ * @param streamno Stream to send the message to.
+ * @param context Context of the message, reported back if sending fails.
+ */
+void set_sndinfo_cmsg( struct msghdr *msg, uint8_t *cbuf, uint32_t ppid,
+                uint16_t streamno, uint32_t context )
+{
+        struct cmsghdr *cmsg;
+        struct sctp_sndinfo *sinfo;
+        struct sctp_prinfo *prinfo;
+
+        msg->msg_control = cbuf;
+        msg->msg_controllen = CMSG_SPACE(sizeof(*sinfo));
+        if ( send_policy.pr_policy != SCTP_PR_SCTP_NONE )
+                msg->msg_controllen += CMSG_SPACE(sizeof(*prinfo));
+        memset( cbuf, 0, msg->msg_controllen );
+        cmsg = CMSG_FIRSTHDR( msg );
+        cmsg->cmsg_level = IPPROTO_SCTP;
+        cmsg->cmsg_type = SCTP_SNDINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(*sinfo));
+        sinfo = (struct sctp_sndinfo *)CMSG_DATA( cmsg );
+        sinfo->snd_sid = streamno;
+        sinfo->snd_flags = send_policy.flags;
+        sinfo->snd_ppid = ppid;
+        sinfo->snd_context = context;
+
+        if ( send_policy.pr_policy == SCTP_PR_SCTP_NONE )
+                return;
+
+        cmsg = CMSG_NXTHDR( msg, cmsg );
+        cmsg->cmsg_level = IPPROTO_SCTP;
+        cmsg->cmsg_type = SCTP_PRINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(*prinfo));
+        prinfo = (struct sctp_prinfo *)CMSG_DATA( cmsg );
+        prinfo->pr_policy = send_policy.pr_policy;
+        prinfo->pr_value = send_policy.pr_value;
+}
+
+/**
+ * Read SCTP information from received control message.
+ *
+ * Both SCTP_SNDRCV and SCTP_RCVINFO are understood, other control messages
+ * are ignored.
+ *
+ * @param cmsg The control message.
+ * @param info Pointer to the structure to fill.
+ * @return 1 if the information was read from the control message, 0 if
+ * it was not SCTP information.
+ */
+int get_rcvinfo_cmsg( struct cmsghdr *cmsg, struct sctp_sndrcvinfo *info )
+{
+        struct sctp_rcvinfo *rinfo;
+
+        if ( cmsg->cmsg_level != IPPROTO_SCTP )
+                return 0;
+
+        if ( cmsg->cmsg_type == SCTP_SNDRCV ) {
+                memcpy( info, CMSG_DATA(cmsg), sizeof(*info));
+                return 1;
+        } else if ( cmsg->cmsg_type == SCTP_RCVINFO ) {
+                rinfo = (struct sctp_rcvinfo *)CMSG_DATA(cmsg);
+                info->sinfo_stream = rinfo->rcv_sid;
+                info->sinfo_ssn = rinfo->rcv_ssn;
+                info->sinfo_flags = rinfo->rcv_flags;
+                info->sinfo_ppid = rinfo->rcv_ppid;
+                info->sinfo_context = rinfo->rcv_context;
+                info->sinfo_tsn = rinfo->rcv_tsn;
+                info->sinfo_cumtsn = rinfo->rcv_cumtsn;
+                info->sinfo_assoc_id = rinfo->rcv_assoc_id;
+                return 1;
+        }
+        return 0;
+}
+
 /**
  * Print error message to user.
  *
@@ -326,6 +731,7 @@ int subscribe_to_events( int sock )
         memset( &event, 0, sizeof( event ));
         event.sctp_data_io_event = 1;
         event.sctp_association_event = 1;
+        event.sctp_address_event = 1;
         event.sctp_shutdown_event = 1;
         event.sctp_send_failure_event = 1;
         event.sctp_authentication_event = 1;
@@ -339,6 +745,98 @@ int subscribe_to_events( int sock )
         return 0;
 }
 
+/**
+ * Released partial store buffers of one size class.
+ */
+struct pstore_class {
+        uint8_t *bufs[PSTORE_POOL_DEPTH]; /**< The buffers */
+        unsigned int count; /**< Number of buffers on the class */
+};
+
+/**
+ * Pool of partial store buffers, the size of buffers on class n is 
+ * 1 << (PSTORE_MIN_SHIFT + n) bytes. 
+ */
+static __thread struct pstore_class pstore_pool[PSTORE_POOL_CLASSES];
+
+/**
+ * Number of bytes on the partial store pool, at most PSTORE_POOL_MAX_BYTES.
+ */
+static __thread size_t pstore_pool_bytes;
+
+/**
+ * Get buffer for the partial store from the pool.
+ *
+ * @param need Minimum number of bytes needed.
+ * @param size Pointer where the size of the buffer is saved.
+ * @return The buffer.
+ */
+static uint8_t *pstore_buf_get( size_t need, size_t *size )
+{
+        struct pstore_class *cls;
+        unsigned int n = 0;
+
+        while ( n < PSTORE_POOL_CLASSES && 
+                        ((size_t)1 << (PSTORE_MIN_SHIFT + n)) < need )
+                n++;
+        if ( n == PSTORE_POOL_CLASSES ) {
+                /* too large to pool */
+                *size = need;
+                return mem_alloc( need );
+        }
+        *size = (size_t)1 << (PSTORE_MIN_SHIFT + n);
+        cls = &pstore_pool[n];
+        if ( cls->count > 0 ) {
+                pstore_pool_bytes -= *size;
+                return cls->bufs[--cls->count];
+        }
+
+        TRACE("Allocating partial buffer of %zu bytes\n", *size );
+        return mem_alloc( *size );
+}
+
+/**
+ * Return the partial store buffer to the pool, or release it if the pool
+ * has no room for it on its size class or in total.
+ *
+ * @param buf The buffer.
+ * @param size Size of the buffer.
+ */
+static void pstore_buf_put( uint8_t *buf, size_t size )
+{
+        struct pstore_class *cls;
+        unsigned int n = 0;
+
+        while ( n < PSTORE_POOL_CLASSES && 
+                        ((size_t)1 << (PSTORE_MIN_SHIFT + n)) < size )
+                n++;
+        if ( n < PSTORE_POOL_CLASSES && 
+                        ((size_t)1 << (PSTORE_MIN_SHIFT + n)) == size ) {
+                cls = &pstore_pool[n];
+                if ( cls->count < PSTORE_POOL_DEPTH && 
+                                pstore_pool_bytes + size <= PSTORE_POOL_MAX_BYTES ) {
+                        cls->bufs[cls->count++] = buf;
+                        pstore_pool_bytes += size;
+                        return;
+                }
+        }
+        mem_free( buf );
+}
+
+/**
+ * Release the buffers on the partial store pool of the calling thread.
+ */
+void partial_store_pool_free()
+{
+        unsigned int n;
+
+        for ( n = 0; n < PSTORE_POOL_CLASSES; n++ ) {
+                while ( pstore_pool[n].count > 0 ) 
+                        mem_free( pstore_pool[n].bufs[--pstore_pool[n].count] );
+        }
+        pstore_pool_bytes = 0;
+}
+
 /**
  * Initialize the partial store context. 
  * @param store Pointer to the partial storage context.
@@ -359,25 +857,19 @@ void partial_store_init( struct partial_store *store )
  */
 int partial_store_collect( struct partial_store *ctx, uint8_t *buf, int len)
 {
-        int remaining;
-
-        if ( ctx->partial_buf == NULL ) {
-                ctx->partial_size = len * 2;
-                TRACE("Initial size of partial buffer is %d \n",
-                                ctx->partial_size);
-                ctx->partial_buf = mem_alloc( ctx->partial_size );
-                ctx->partial_len = 0;
-        }
-        remaining = ctx->partial_size - ctx->partial_len;
-        if (remaining < len ) {
-                /* need to reallocate the buffer */
-                ctx->partial_size = ctx->partial_size * 2;
-                if (ctx->partial_size < ctx->partial_len + len)
-                        ctx->partial_size = ctx->partial_len + len;
+        uint8_t *newbuf;
+        size_t newsize;
 
-                ctx->partial_buf = mem_realloc( ctx->partial_buf, ctx->partial_size );
-                TRACE("Reallocated partial buffer, length now %d \n",
-                                ctx->partial_size);
+        if ( ctx->partial_size - ctx->partial_len < (size_t)len ) {
+                /* move to larger buffer from the pool */
+                newbuf = pstore_buf_get( ctx->partial_len + len, &newsize );
+                if ( ctx->partial_buf != NULL ) {
+                        memcpy( newbuf, ctx->partial_buf, ctx->partial_len );
+                        pstore_buf_put( ctx->partial_buf, ctx->partial_size );
+                }
+                ctx->partial_buf = newbuf;
+                ctx->partial_size = newsize;
+                TRACE("Partial buffer size now %zu \n", ctx->partial_size);
         }
         /* Copy the received data to the end of the partial buffer */
         memcpy(ctx->partial_buf + ctx->partial_len,
@@ -419,6 +911,21 @@ void partial_store_flush(struct partial_store *ctx)
 {
         ctx->partial_len = 0;
 }
+
+/**
+ * Release the memory allocated for the partial storage. 
+ * The storage can be used again after this call. The buffer is returned
+ * to the pool of the calling thread.
+ *
+ * @param ctx Pointer to partial storage context.
+ */
+void partial_store_free(struct partial_store *ctx)
+{
+        if (ctx->partial_buf != NULL)
+                pstore_buf_put(ctx->partial_buf, ctx->partial_size);
+
+        partial_store_init(ctx);
+}
 /**
  * Print the address and port from given sockaddr to stdout.
  * @param ss Pointer to sockaddr which should be printed.
@@ -457,6 +964,8 @@ void print_ss( struct sockaddr_storage *ss )
 void print_input( struct sockaddr_storage *from, int len, int flags, 
                 struct sctp_sndrcvinfo *info)
 {
+        if ( outlog_input( from, len, flags, info ) == 0 )
+                return;
 
         printf("< ");
         print_ss(from);
@@ -484,6 +993,9 @@ void print_input( struct sockaddr_storage *from, int len, int flags,
  */
 void print_output( struct sockaddr_storage *to, int len)
 {
+        if ( outlog_output( to, len, 0, 0, 0 ) == 0 )
+                return;
+
         printf("> ");
         print_ss(to);
         printf(" (%d bytes)", len);
@@ -500,11 +1012,122 @@ void print_output( struct sockaddr_storage *to, int len)
 void print_output_verbose( struct sockaddr_storage *to, int len,
                 uint32_t ppid, uint16_t streamno)
 {
+        if ( outlog_output( to, len, 1, ppid, streamno ) == 0 )
+                return;
+
         print_output(to,len);
         printf("\t stream: %d ppid: %d\n",
                         streamno, ppid);
 }
 
+/**
+ * Print the number of the message about to be sent to stdout.
+ * @param n Number of the message, starting from 1.
+ * @param count Total number of messages to send.
+ */
+void print_progress( uint32_t n, uint32_t count )
+{
+        if ( outlog_progress( n, count ) == 0 )
+                return;
+
+        printf("Sending chunk %" PRIu32 "/%" PRIu32 " \n", n, count);
+}
+
+#ifdef SCTP_STREAM_SCHEDULER
+/**
+ * Names of the stream schedulers, in the order of enum sctp_sched_type.
+ * Fair capacity and WFQ are available on Linux 6.0 and later.
+ */
+static const char *sched_names[] = { "fcfs", "prio", "rr", "fc", "wfq" };
+
+/**
+ * Number of known stream schedulers.
+ */
+#define SCHED_COUNT (sizeof(sched_names) / sizeof(sched_names[0]))
+#endif /* SCTP_STREAM_SCHEDULER */
+
+/**
+ * Parse the name of the stream scheduler.
+ * @param arg The name given on command line
+ * @param tuning The socket options to set the scheduler to
+ * @return 0 on success, -1 if the scheduler is unknown or not supported.
+ */
+static int parse_sched(char *arg, struct sock_tuning *tuning)
+{
+#ifdef SCTP_STREAM_SCHEDULER
+        uint32_t i;
+
+        for (i = 0; i < SCHED_COUNT; i++) {
+                if (strcmp(arg, sched_names[i]) == 0) {
+                        tuning->sched = i;
+                        tuning->set |= TUNE_SCHED;
+                        return 0;
+                }
+        }
+        fprintf(stderr, "Unknown stream scheduler %s\n", arg);
+#else
+        (void)arg;
+        (void)tuning;
+        fprintf(stderr, "Stream schedulers are not supported\n");
+#endif /* SCTP_STREAM_SCHEDULER */
+        return -1;
+}
+
+/**
+ * Parse the partially reliable delivery policy, ttl:<ms>, rtx:<n> or
+ * prio:<n>.
+ * @param arg The policy given on command line
+ * @param policy The send policy to set the PR-SCTP policy to
+ * @return 0 on success, -1 if the policy is invalid.
+ */
+static int parse_pr(char *arg, struct send_policy *policy)
+{
+        char *value;
+
+        value = strchr(arg, ':');
+        if (value == NULL) {
+                fprintf(stderr, "Invalid PR-SCTP policy given (expected "
+                                "ttl:<ms>, rtx:<n> or prio:<n>)\n");
+                return -1;
+        }
+        *value++ = '\0';
+        if (strcmp(arg, "ttl") == 0) {
+                policy->pr_policy = SCTP_PR_SCTP_TTL;
+        } else if (strcmp(arg, "rtx") == 0) {
+                policy->pr_policy = SCTP_PR_SCTP_RTX;
+        } else if (strcmp(arg, "prio") == 0) {
+                policy->pr_policy = SCTP_PR_SCTP_PRIO;
+        } else {
+                fprintf(stderr, "Unknown PR-SCTP policy %s\n", arg);
+                return -1;
+        }
+        if (parse_uint32(value, &policy->pr_value) < 0) {
+                fprintf(stderr, "Invalid value for PR-SCTP policy %s\n", arg);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Parse value for one of the socket tuning options.
+ * @param arg The value given on command line
+ * @param dst Pointer where to store the value
+ * @param set Pointer to the TUNE_* bits of the options given
+ * @param bit The TUNE_* bit to set for this option
+ * @param what Description of the option for the error message
+ * @return 0 on success, -1 if the value is invalid.
+ */
+static int parse_tuning(char *arg, uint32_t *dst, uint32_t *set, 
+                uint32_t bit, const char *what)
+{
+        if (parse_uint32(arg, dst) < 0) {
+                fprintf(stderr, "Invalid %s given\n", what);
+                return -1;
+        }
+        *set |= bit;
+        return 0;
+}
+
 /**
  * Parse common command line arguments.
  * @param c The command line short argument
@@ -538,6 +1161,109 @@ int common_parse_args(int c, char *arg, struct common_context *ctx)
                 case 'x' :
                         ctx->options = set_flag(ctx->options, XDUMP_FLAG);
                         break;
+                case 'i' :
+                        if (parse_interval(arg, &ctx->interval_ns) < 0) {
+                                fprintf(stderr, "Invalid interval given\n");
+                                return -1;
+                        }
+                        ctx->options = set_flag(ctx->options, REPORT_FLAG);
+                        break;
+                case 'g' :
+                        if (strcmp(arg, "classic") == 0) {
+                                ctx->engine = ENGINE_CLASSIC;
+                        } else if (strcmp(arg, "uring") == 0) {
+#ifdef HAVE_URING
+                                ctx->engine = ENGINE_URING;
+#else
+                                fprintf(stderr, "io_uring engine is not available, build with URING=1\n");
+                                return -1;
+#endif /* HAVE_URING */
+                        } else {
+                                fprintf(stderr, "Unknown I/O engine %s\n", arg);
+                                return -1;
+                        }
+                        break;
+                case OPT_SNDBUF :
+                        return parse_tuning(arg, &ctx->tuning.sndbuf, 
+                                        &ctx->tuning.set, TUNE_SNDBUF, "send buffer size");
+                case OPT_RCVBUF :
+                        return parse_tuning(arg, &ctx->tuning.rcvbuf, 
+                                        &ctx->tuning.set, TUNE_RCVBUF, "receive buffer size");
+                case OPT_NODELAY :
+                        ctx->tuning.set |= TUNE_NODELAY;
+                        break;
+                case OPT_MAXSEG :
+                        return parse_tuning(arg, &ctx->tuning.maxseg, 
+                                        &ctx->tuning.set, TUNE_MAXSEG, "maximum segment size");
+                case OPT_FRAG_INTERLEAVE :
+                        if (parse_tuning(arg, &ctx->tuning.frag_interleave, 
+                                        &ctx->tuning.set, TUNE_FRAG_INTERLEAVE,
+                                        "fragment interleave level") < 0)
+                                return -1;
+                        if (ctx->tuning.frag_interleave > 2) {
+                                fprintf(stderr, "Invalid fragment interleave level given (expected 0-2)\n");
+                                return -1;
+                        }
+                        break;
+                case OPT_PD_POINT :
+                        return parse_tuning(arg, &ctx->tuning.pd_point, 
+                                        &ctx->tuning.set, TUNE_PD_POINT, "partial delivery point");
+                case OPT_SACK_DELAY :
+                        return parse_tuning(arg, &ctx->tuning.sack_delay, 
+                                        &ctx->tuning.set, TUNE_DELAYED_SACK, "SACK delay");
+                case OPT_SACK_FREQ :
+                        return parse_tuning(arg, &ctx->tuning.sack_freq, 
+                                        &ctx->tuning.set, TUNE_DELAYED_SACK, "SACK frequency");
+                case OPT_MAX_BURST :
+                        return parse_tuning(arg, &ctx->tuning.max_burst, 
+                                        &ctx->tuning.set, TUNE_MAX_BURST, "maximum burst");
+                case OPT_RTO_MAX :
+                        return parse_tuning(arg, &ctx->tuning.rto_max, 
+                                        &ctx->tuning.set, TUNE_RTO_MAX, "maximum RTO");
+                case OPT_PATH_MAX_RETRANS :
+                        return parse_tuning(arg, &ctx->tuning.path_max_retrans, 
+                                        &ctx->tuning.set, TUNE_PATH_MAX_RETRANS, 
+                                        "path maximum retransmissions");
+                case OPT_SCHED :
+                        return parse_sched(arg, &ctx->tuning);
+                case OPT_INTERLEAVE :
+                        /* I-DATA is accepted only with level 2 */
+                        if (!(ctx->tuning.set & TUNE_FRAG_INTERLEAVE)) {
+                                ctx->tuning.frag_interleave = 2;
+                                ctx->tuning.set |= TUNE_FRAG_INTERLEAVE;
+                        }
+                        ctx->tuning.set |= TUNE_INTERLEAVE;
+                        break;
+                case OPT_UNORDERED :
+                        ctx->send.flags |= SCTP_UNORDERED;
+                        break;
+                case OPT_PR :
+                        return parse_pr(arg, &ctx->send);
+                case OPT_BIND :
+                        if (addr_set_add(&ctx->laddrs, arg) < 0) {
+                                fprintf(stderr, "Invalid local address given "
+                                                "(at most %d can be given)\n", MAX_ADDRS);
+                                return -1;
+                        }
+                        break;
+                case OPT_BUSY_POLL :
+                        ctx->options = set_flag(ctx->options, BUSY_POLL_FLAG);
+                        break;
+                case OPT_CPU :
+                        if (parse_uint16(arg, &streams) < 0 || streams >= CPU_SETSIZE) {
+                                fprintf(stderr, "Invalid CPU given\n");
+                                return -1;
+                        }
+                        ctx->cpu = streams;
+                        break;
+                case 'N' :
+                        if (parse_uint16(arg, &ctx->batch) < 0 || 
+                                        ctx->batch == 0 || ctx->batch > BATCH_MAX) {
+                                fprintf(stderr, "Invalid batch size given (expected 1-%d)\n",
+                                                BATCH_MAX);
+                                return -1;
+                        }
+                        break;
                 case 'I' :
                         if (parse_uint16(arg, &streams) < 0 ) {
                                 fprintf(stderr,
@@ -628,6 +1354,35 @@ void common_print_usage()
         printf("\t--echo         : Echo mode\n");
         printf("\t--verbose      : Be more verbosive \n");
         printf("\t--xdump        : Print hexdump of received data \n");
+        printf("\t--interval <s> : Report throughput every <s> seconds instead of\n");
+        printf("\t                 printing each message\n");
+        printf("\t--batch <n>    : Send and receive up to <n> messages with one system call\n");
+        printf("\t                 (with --seq only)\n");
+        printf("\t--engine <e>   : I/O engine to use, classic (default) or uring\n");
+        printf("\t--sndbuf <b>   : Set SO_SNDBUF of the socket to <b> bytes\n");
+        printf("\t--rcvbuf <b>   : Set SO_RCVBUF of the socket to <b> bytes\n");
+        printf("\t--nodelay      : Set SCTP_NODELAY, disable Nagle algorithm\n");
+        printf("\t--maxseg <b>   : Set SCTP_MAXSEG, the maximum size of DATA chunks\n");
+        printf("\t--frag-interleave <l> : Set SCTP_FRAGMENT_INTERLEAVE level (0-2)\n");
+        printf("\t--pd-point <b> : Set SCTP_PARTIAL_DELIVERY_POINT to <b> bytes\n");
+        printf("\t--sack-delay <ms> : Set the delay of delayed SACK in milliseconds\n");
+        printf("\t--sack-freq <n>: Send SACK for every <n> packets (1 disables delayed SACK)\n");
+        printf("\t--max-burst <n>: Set SCTP_MAX_BURST, packets sent at once\n");
+        printf("\t--rto-max <ms> : Set the maximum retransmission timeout\n");
+        printf("\t--path-max-retrans <n> : Mark path failed after <n> retransmissions\n");
+        printf("\t--sched <s>    : Set SCTP_STREAM_SCHEDULER, fcfs, prio, rr, fc or wfq\n");
+        printf("\t--interleave   : Set SCTP_INTERLEAVING_SUPPORTED to use I-DATA chunks, with\n");
+        printf("\t                 fragment interleave level 2 (needs net.sctp.intl_enable=1)\n");
+        printf("\t--unordered    : Send the messages for unordered delivery\n");
+        printf("\t--pr <p>:<v>   : Partially reliable delivery, abandon the message after\n");
+        printf("\t                 ttl:<ms> lifetime, rtx:<n> retransmissions or when\n");
+        printf("\t                 the send buffer is full and prio:<n> is the lowest\n");
+        printf("\t                 priority (0 is the highest)\n");
+        printf("\t--bind <addr>  : Bind to local address <addr>, can be given up to %d\n", MAX_ADDRS);
+        printf("\t                 times for a multihomed endpoint\n");
+        printf("\t--busy-poll    : Spin on non-blocking reads instead of sleeping, set\n");
+        printf("\t                 SO_BUSY_POLL and lock the memory (see RLIMIT_MEMLOCK)\n");
+        printf("\t--cpu <n>      : Pin the I/O thread to CPU <n> (worker i to <n>+i)\n");
         printf("\t--instreams    : Maximum number of input streams to negotiate for the association\n");
         printf("\t--outstreams   : Number of output streams to negotiate\n");
         printf("\t--help         : Print this message \n");
@@ -644,35 +1399,316 @@ void common_print_usage()
 }
 
 /**
- * Do initialization for the common part.
+ * Set the requested socket options on socket.
+ *
+ * Failure to set one of the options explicitly requested by user is an
+ * error, there would be no point benchmarking with settings other than
+ * those asked for.
+ *
+ * @param sock The socket to configure
+ * @param tuning The socket options to set
+ * @return 0 on success, -1 on error.
+ */
+static int apply_tuning(int sock, struct sock_tuning *tuning)
+{
+        struct sctp_assoc_value av;
+        struct sctp_sack_info sack;
+        struct sctp_rtoinfo rto;
+        struct sctp_paddrparams paddr;
+        socklen_t len;
+        int val;
+
+        if (tuning->set & TUNE_SNDBUF) {
+                val = tuning->sndbuf;
+                if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0) {
+                        print_error("Unable to set SO_SNDBUF", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_RCVBUF) {
+                val = tuning->rcvbuf;
+                if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) < 0) {
+                        print_error("Unable to set SO_RCVBUF", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_NODELAY) {
+                val = 1;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_NODELAY, &val, sizeof(val)) < 0) {
+                        print_error("Unable to set SCTP_NODELAY", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_MAXSEG) {
+                memset(&av, 0, sizeof(av));
+                av.assoc_value = tuning->maxseg;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_MAXSEG, &av, sizeof(av)) < 0) {
+                        print_error("Unable to set SCTP_MAXSEG", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_FRAG_INTERLEAVE) {
+                val = tuning->frag_interleave;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_FRAGMENT_INTERLEAVE, 
+                                        &val, sizeof(val)) < 0) {
+                        print_error("Unable to set SCTP_FRAGMENT_INTERLEAVE", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_INTERLEAVE) {
+#ifdef SCTP_INTERLEAVING_SUPPORTED
+                if (tuning->frag_interleave != 2) {
+                        fprintf(stderr, "I-DATA interleaving requires fragment interleave level 2\n");
+                        return -1;
+                }
+                memset(&av, 0, sizeof(av));
+                av.assoc_value = 1;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_INTERLEAVING_SUPPORTED, 
+                                        &av, sizeof(av)) < 0) {
+                        print_error("Unable to set SCTP_INTERLEAVING_SUPPORTED "
+                                        "(is net.sctp.intl_enable set?)", errno);
+                        return -1;
+                }
+#else
+                fprintf(stderr, "I-DATA interleaving is not supported\n");
+                return -1;
+#endif /* SCTP_INTERLEAVING_SUPPORTED */
+        }
+        if (tuning->set & TUNE_PD_POINT) {
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_PARTIAL_DELIVERY_POINT,
+                                        &tuning->pd_point, sizeof(tuning->pd_point)) < 0) {
+                        print_error("Unable to set SCTP_PARTIAL_DELIVERY_POINT", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_DELAYED_SACK) {
+                /* 
+                 * Start from the current values so that only one of delay
+                 * and frequency can be given.
+                 */
+                memset(&sack, 0, sizeof(sack));
+                len = sizeof(sack);
+                if (getsockopt(sock, IPPROTO_SCTP, SCTP_DELAYED_SACK, &sack, &len) < 0) {
+                        print_error("Unable to get SCTP_DELAYED_SACK", errno);
+                        return -1;
+                }
+                if (tuning->sack_delay > 0)
+                        sack.sack_delay = tuning->sack_delay;
+                if (tuning->sack_freq > 0)
+                        sack.sack_freq = tuning->sack_freq;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_DELAYED_SACK, 
+                                        &sack, sizeof(sack)) < 0) {
+                        print_error("Unable to set SCTP_DELAYED_SACK", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_MAX_BURST) {
+                memset(&av, 0, sizeof(av));
+                av.assoc_value = tuning->max_burst;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_MAX_BURST, &av, sizeof(av)) < 0) {
+                        print_error("Unable to set SCTP_MAX_BURST", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_RTO_MAX) {
+                /* minimum and initial RTO may not exceed the maximum */
+                memset(&rto, 0, sizeof(rto));
+                len = sizeof(rto);
+                if (getsockopt(sock, IPPROTO_SCTP, SCTP_RTOINFO, &rto, &len) < 0) {
+                        print_error("Unable to get SCTP_RTOINFO", errno);
+                        return -1;
+                }
+                rto.srto_max = tuning->rto_max;
+                if (rto.srto_min > rto.srto_max)
+                        rto.srto_min = rto.srto_max;
+                if (rto.srto_initial > rto.srto_max)
+                        rto.srto_initial = rto.srto_max;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_RTOINFO, &rto, sizeof(rto)) < 0) {
+                        print_error("Unable to set SCTP_RTOINFO", errno);
+                        return -1;
+                }
+        }
+        if (tuning->set & TUNE_PATH_MAX_RETRANS) {
+                memset(&paddr, 0, sizeof(paddr));
+                paddr.spp_pathmaxrxt = tuning->path_max_retrans;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_PEER_ADDR_PARAMS, 
+                                        &paddr, sizeof(paddr)) < 0) {
+                        print_error("Unable to set SCTP_PEER_ADDR_PARAMS", errno);
+                        return -1;
+                }
+        }
+#ifdef SCTP_STREAM_SCHEDULER
+        if (tuning->set & TUNE_SCHED) {
+                /* the default for the associations of the socket */
+                memset(&av, 0, sizeof(av));
+                av.assoc_value = tuning->sched;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER, 
+                                        &av, sizeof(av)) < 0) {
+                        print_error("Unable to set SCTP_STREAM_SCHEDULER", errno);
+                        return -1;
+                }
+        }
+#endif /* SCTP_STREAM_SCHEDULER */
+        return 0;
+}
+
+/**
+ * Print the effective values of the tunable socket options.
+ *
+ * The kernel may adjust the requested values (for example SO_SNDBUF is
+ * doubled and clamped by net.core.wmem_max), so the values are read back
+ * from the socket. Nothing is printed unless some option was given or
+ * verbose mode is on.
+ *
  * @param ctx Pointer to the common context
+ * @param sock The socket to query
  */
-int common_init(struct common_context *ctx)
+void common_print_tuning(struct common_context *ctx, int sock)
 {
-        ctx->sock = -1; 
+        struct sctp_assoc_value av;
+        struct sctp_sack_info sack;
+        struct sctp_rtoinfo rto;
+        struct sctp_paddrparams paddr;
+        uint32_t pd_point;
+        socklen_t len;
+        int val;
+
+        if (ctx->tuning.set == 0 && ctx->send.pr_policy == SCTP_PR_SCTP_NONE &&
+                        !is_flag(ctx->options, VERBOSE_FLAG))
+                return;
+
+        printf("Socket options:");
+        len = sizeof(val);
+        if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &val, &len) == 0)
+                printf(" sndbuf=%d", val);
+        len = sizeof(val);
+        if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &val, &len) == 0)
+                printf(" rcvbuf=%d", val);
+        len = sizeof(val);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_NODELAY, &val, &len) == 0)
+                printf(" nodelay=%d", val);
+        memset(&av, 0, sizeof(av));
+        len = sizeof(av);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_MAXSEG, &av, &len) == 0)
+                printf(" maxseg=%u", av.assoc_value);
+        len = sizeof(val);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_FRAGMENT_INTERLEAVE, &val, &len) == 0)
+                printf(" frag-interleave=%d", val);
+        len = sizeof(pd_point);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_PARTIAL_DELIVERY_POINT, 
+                                &pd_point, &len) == 0)
+                printf(" pd-point=%u", pd_point);
+        memset(&sack, 0, sizeof(sack));
+        len = sizeof(sack);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_DELAYED_SACK, &sack, &len) == 0)
+                printf(" sack-delay=%u sack-freq=%u", sack.sack_delay, sack.sack_freq);
+        memset(&av, 0, sizeof(av));
+        len = sizeof(av);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_MAX_BURST, &av, &len) == 0)
+                printf(" max-burst=%u", av.assoc_value);
+#ifdef SCTP_INTERLEAVING_SUPPORTED
+        memset(&av, 0, sizeof(av));
+        len = sizeof(av);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_INTERLEAVING_SUPPORTED, &av, &len) == 0)
+                printf(" interleave=%u", av.assoc_value);
+#endif /* SCTP_INTERLEAVING_SUPPORTED */
+        memset(&rto, 0, sizeof(rto));
+        len = sizeof(rto);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_RTOINFO, &rto, &len) == 0)
+                printf(" rto-min=%u rto-max=%u", rto.srto_min, rto.srto_max);
+        memset(&paddr, 0, sizeof(paddr));
+        len = sizeof(paddr);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_PEER_ADDR_PARAMS, &paddr, &len) == 0)
+                printf(" path-max-retrans=%u", paddr.spp_pathmaxrxt);
+#ifdef SCTP_STREAM_SCHEDULER
+        memset(&av, 0, sizeof(av));
+        len = sizeof(av);
+        if (getsockopt(sock, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER, &av, &len) == 0) {
+                if (av.assoc_value < SCHED_COUNT)
+                        printf(" sched=%s", sched_names[av.assoc_value]);
+                else
+                        printf(" sched=%u", av.assoc_value);
+        }
+#endif /* SCTP_STREAM_SCHEDULER */
+        if (ctx->send.pr_policy != SCTP_PR_SCTP_NONE) {
+                memset(&av, 0, sizeof(av));
+                len = sizeof(av);
+                if (getsockopt(sock, IPPROTO_SCTP, SCTP_PR_SUPPORTED, &av, &len) == 0)
+                        printf(" pr-supported=%u", av.assoc_value);
+        }
+        printf("\n");
+}
+
+/**
+ * Create new SCTP socket configured according to the common context.
+ *
+ * This can be used to create any number of identically configured
+ * sockets. The send policy of the context is taken into use for all the
+ * messages sent. The effective socket options are printed for the first
+ * socket created with the context only.
+ *
+ * @param ctx Pointer to the common context
+ * @return The new socket, -1 on error.
+ */
+int common_create_socket(struct common_context *ctx)
+{
+        struct sctp_assoc_value av;
+        int sock, on;
+
         if ( is_flag( ctx->options, SEQ_FLAG )) {
                 DBG("Using SEQPKT socket\n");
-                ctx->sock = socket( PF_INET6, SOCK_SEQPACKET, IPPROTO_SCTP );
+                sock = socket( PF_INET6, SOCK_SEQPACKET, IPPROTO_SCTP );
         } else {
                 DBG("Using STREAM socket\n");
-                ctx->sock = socket( PF_INET6, SOCK_STREAM, IPPROTO_SCTP );
+                sock = socket( PF_INET6, SOCK_STREAM, IPPROTO_SCTP );
         }
-        if ( ctx->sock < 0 ) {
+        if ( sock < 0 ) {
                 fprintf(stderr, "Unable to create socket: %s \n",
                                 strerror(errno));
-                ctx->sock = -1;
                 return -1;
         }
         if (ctx->initmsg != NULL ) {
                 TRACE("Requesting for %d output streams and at max %d input streams\n",
                                 ctx->initmsg->sinit_num_ostreams,
                                 ctx->initmsg->sinit_max_instreams);
-                if (setsockopt( ctx->sock, SOL_SCTP, SCTP_INITMSG, 
+                if (setsockopt( sock, SOL_SCTP, SCTP_INITMSG, 
                                         ctx->initmsg, sizeof(*ctx->initmsg)) < 0) {
                         fprintf(stderr,"Warning: unable to set the association parameters: %s\n",
                                         strerror(errno));
                 }
         }
+        if (apply_tuning(sock, &ctx->tuning) < 0) {
+                close(sock);
+                return -1;
+        }
+        if (ctx->send.pr_policy != SCTP_PR_SCTP_NONE) {
+                memset(&av, 0, sizeof(av));
+                av.assoc_value = 1;
+                if (setsockopt(sock, IPPROTO_SCTP, SCTP_PR_SUPPORTED,
+                                        &av, sizeof(av)) < 0) {
+                        fprintf(stderr, "Unable to enable PR-SCTP: %s\n",
+                                        strerror(errno));
+                        close(sock);
+                        return -1;
+                }
+        }
+        send_policy = ctx->send;
+        if (is_flag(ctx->options, BUSY_POLL_FLAG)) {
+                on = BUSY_POLL_USEC;
+                if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, 
+                                        &on, sizeof(on)) < 0) {
+                        fprintf(stderr,"Warning: unable to set SO_BUSY_POLL: %s\n",
+                                        strerror(errno));
+                }
+        }
+        if (ctx->batch > 0) {
+                on = 1;
+                if (setsockopt( sock, IPPROTO_SCTP, SCTP_RECVRCVINFO,
+                                        &on, sizeof(on)) < 0) {
+                        fprintf(stderr,"Warning: unable to enable SCTP_RCVINFO: %s\n",
+                                        strerror(errno));
+                }
+        }
         if (is_flag(ctx->options, AUTH_FLAG)) {
                         ASSERT(ctx->actx != NULL);
 #ifdef DEBUG
@@ -680,13 +1716,78 @@ int common_init(struct common_context *ctx)
 #endif /* DEBUG */
                         if (!AUTHCTX_HAS_KEY(ctx->actx)) {
                                 fprintf(stderr,"No authentication key set\n");
+                                close(sock);
                                 return -1;
                         }
-                        if (auth_set_params(ctx->sock, ctx->actx) != AUTHERR_OK) {
+                        if (auth_set_params(sock, ctx->actx) != AUTHERR_OK) {
                                 fprintf(stderr,"Unable to set authentication parameters\n");
+                                close(sock);
                                 return -1;
                         }
         }
+        if (!ctx->tuning_printed) {
+                common_print_tuning(ctx, sock);
+                ctx->tuning_printed = 1;
+        }
+        return sock;
+}
+
+/**
+ * Start writing the per-message output from separate thread, unless
+ * there is no per-message output (throughput reports are printed instead)
+ * or the hexdumps, printed directly, would get out of order.
+ *
+ * @param ctx Pointer to the common context
+ */
+void common_start_output(struct common_context *ctx)
+{
+        if (is_flag(ctx->options, REPORT_FLAG) || 
+                        is_flag(ctx->options, XDUMP_FLAG))
+                return;
+
+        outlog_start(); /* on error the output is just printed directly */
+}
+
+/**
+ * Prepare the calling thread for the I/O loop. 
+ *
+ * The thread is pinned to the requested CPU and, in busy poll mode, all
+ * the memory is locked (and so faulted in) to avoid page faults on the
+ * I/O path. This should be called once the buffers are allocated. 
+ * Failures are not fatal, the measurement is still valid.
+ *
+ * @param ctx Pointer to the common context
+ * @param offset Offset to the CPU to pin to, the number of worker.
+ */
+void common_prepare_io(struct common_context *ctx, int offset)
+{
+        cpu_set_t set;
+
+        if (ctx->cpu >= 0) {
+                CPU_ZERO(&set);
+                CPU_SET((ctx->cpu + offset) % CPU_SETSIZE, &set);
+                if (sched_setaffinity(0, sizeof(set), &set) < 0) 
+                        fprintf(stderr, "Warning: unable to pin to CPU %d: %s\n",
+                                        ctx->cpu + offset, strerror(errno));
+                else {
+                        DBG("Pinned to CPU %d\n", ctx->cpu + offset);
+                }
+        }
+        if (is_flag(ctx->options, BUSY_POLL_FLAG) && mlockall(MCL_CURRENT) < 0) 
+                fprintf(stderr, "Warning: unable to lock memory: %s\n",
+                                strerror(errno));
+}
+
+/**
+ * Do initialization for the common part.
+ * @param ctx Pointer to the common context
+ */
+int common_init(struct common_context *ctx)
+{
+        ctx->sock = common_create_socket(ctx);
+        if ( ctx->sock < 0 ) 
+                return -1;
+
         return 0;
 }
 
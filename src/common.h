@@ -32,8 +32,33 @@
 #ifndef _COMMON_H_
 #define _COMMON_H_
 
+/**
+ * Size of the smallest partial store buffer is 1 << PSTORE_MIN_SHIFT.
+ */
+#define PSTORE_MIN_SHIFT 12
+
+/**
+ * Number of buffer size classes on the partial store pool, larger
+ * buffers are not pooled.
+ */
+#define PSTORE_POOL_CLASSES 16
+
+/**
+ * Maximum number of buffers kept on each size class of the pool.
+ */
+#define PSTORE_POOL_DEPTH 8
+
+/**
+ * Maximum number of bytes kept on the partial store pool of a thread,
+ * buffers returned beyond this are released.
+ */
+#define PSTORE_POOL_MAX_BYTES (16 * 1024 * 1024)
+
 /**
  * context for partial storage.
+ *
+ * The buffers are taken from per-thread pool of power of two sized
+ * buffers and returned there once released.
  */
 struct partial_store {
         uint8_t *partial_buf; /**< Buffer to collect the data */
@@ -45,6 +70,40 @@ int partial_store_collect( struct partial_store *ctx, uint8_t *buf, int len);
 int partial_store_len( struct partial_store *ctx);
 uint8_t *partial_store_dataptr(struct partial_store *ctx);
 void partial_store_flush(struct partial_store *ctx);
+void partial_store_free(struct partial_store *ctx);
+void partial_store_pool_free();
+
+/**
+ * Magic number identifying the latency header.
+ */
+#define LATENCY_MAGIC 0x4c415459
+
+/**
+ * Header placed at the start of each message on latency measurement mode.
+ * The header is in host byte order, it is only interpreted by the host
+ * which sent it (or, when the clocks are synchronized, by a server on the
+ * same host).
+ */
+struct latency_hdr {
+        uint32_t magic; /**< LATENCY_MAGIC */
+        uint32_t seq; /**< Sequence number of the message */
+        uint64_t send_ns; /**< Monotonic time the message was sent */
+};
+
+/**
+ * Space needed for the SCTP control messages of one message, fits both
+ * the received SCTP_SNDRCV/SCTP_RCVINFO and the sent SCTP_SNDINFO with
+ * SCTP_PRINFO.
+ */
+#define SCTP_CMSG_SPACE (CMSG_SPACE(sizeof(struct sctp_sndrcvinfo)) + \
+                CMSG_SPACE(sizeof(struct sctp_rcvinfo)))
+
+#ifndef SCTP_EXPLICIT_EOR
+/**
+ * Socket option for explicit end of record, missing from older headers.
+ */
+#define SCTP_EXPLICIT_EOR 131
+#endif /* SCTP_EXPLICIT_EOR */
 
 /**
  * typedef for the flag type.
@@ -52,13 +111,137 @@ void partial_store_flush(struct partial_store *ctx);
  */
 typedef uint16_t flags_t;
 
+/*
+ * Bits for the socket options set on struct sock_tuning.
+ */
+#define TUNE_SNDBUF 0x01
+#define TUNE_RCVBUF 0x01 << 1
+#define TUNE_NODELAY 0x01 << 2
+#define TUNE_MAXSEG 0x01 << 3
+#define TUNE_FRAG_INTERLEAVE 0x01 << 4
+#define TUNE_PD_POINT 0x01 << 5
+#define TUNE_DELAYED_SACK 0x01 << 6
+#define TUNE_MAX_BURST 0x01 << 7
+#define TUNE_RTO_MAX 0x01 << 8
+#define TUNE_PATH_MAX_RETRANS 0x01 << 9
+#define TUNE_SCHED 0x01 << 10
+#define TUNE_INTERLEAVE 0x01 << 11
+
+/**
+ * Socket options to set on the created sockets.
+ */
+struct sock_tuning {
+        uint32_t set; /**< Options given, TUNE_* bits */
+        uint32_t sndbuf; /**< SO_SNDBUF */
+        uint32_t rcvbuf; /**< SO_RCVBUF */
+        uint32_t maxseg; /**< SCTP_MAXSEG */
+        uint32_t frag_interleave; /**< SCTP_FRAGMENT_INTERLEAVE level */
+        uint32_t pd_point; /**< SCTP_PARTIAL_DELIVERY_POINT */
+        uint32_t sack_delay; /**< Delay of SCTP_DELAYED_SACK in ms, 0 to keep */
+        uint32_t sack_freq; /**< Frequency of SCTP_DELAYED_SACK, 0 to keep */
+        uint32_t max_burst; /**< SCTP_MAX_BURST */
+        uint32_t rto_max; /**< Maximum RTO of SCTP_RTOINFO in ms */
+        uint32_t path_max_retrans; /**< Path failure threshold of SCTP_PEER_ADDR_PARAMS */
+        uint32_t sched; /**< SCTP_STREAM_SCHEDULER, value of enum sctp_sched_type */
+};
+
+/**
+ * Delivery options applied to all the messages sent.
+ */
+struct send_policy {
+        uint16_t flags; /**< snd_flags of SCTP_SNDINFO, SCTP_UNORDERED */
+        uint16_t pr_policy; /**< SCTP_PR_SCTP_* policy, SCTP_PR_SCTP_NONE for reliable */
+        uint32_t pr_value; /**< Lifetime in ms, retransmissions or priority */
+};
+
+/**
+ * Maximum number of addresses for one endpoint of a multihomed association.
+ */
+#define MAX_ADDRS 8
+
+/**
+ * Set of addresses for sctp_bindx() and sctp_connectx().
+ */
+struct addr_set {
+        struct sockaddr_storage addrs[MAX_ADDRS]; /**< The addresses, port not set */
+        int count; /**< Number of addresses on the set */
+};
+
+/*
+ * Values for the long options without short option character.
+ */
+#define OPT_SNDBUF 256
+#define OPT_RCVBUF 257
+#define OPT_NODELAY 258
+#define OPT_MAXSEG 259
+#define OPT_FRAG_INTERLEAVE 260
+#define OPT_PD_POINT 261
+#define OPT_SACK_DELAY 262
+#define OPT_SACK_FREQ 263
+#define OPT_MAX_BURST 264
+#define OPT_BUSY_POLL 265
+#define OPT_CPU 266
+#define OPT_BIND 267
+#define OPT_RTO_MAX 268
+#define OPT_PATH_MAX_RETRANS 269
+#define OPT_SCHED 270
+#define OPT_UNORDERED 271
+#define OPT_PR 272
+#define OPT_INTERLEAVE 273
+
+/**
+ * Common long options without short option character, to be included on
+ * the option table of the tools.
+ */
+#define COMMON_LONG_OPTIONS \
+                { "sndbuf",1,0,OPT_SNDBUF }, \
+                { "rcvbuf",1,0,OPT_RCVBUF }, \
+                { "nodelay",0,0,OPT_NODELAY }, \
+                { "maxseg",1,0,OPT_MAXSEG }, \
+                { "frag-interleave",1,0,OPT_FRAG_INTERLEAVE }, \
+                { "pd-point",1,0,OPT_PD_POINT }, \
+                { "sack-delay",1,0,OPT_SACK_DELAY }, \
+                { "sack-freq",1,0,OPT_SACK_FREQ }, \
+                { "max-burst",1,0,OPT_MAX_BURST }, \
+                { "busy-poll",0,0,OPT_BUSY_POLL }, \
+                { "cpu",1,0,OPT_CPU }, \
+                { "bind",1,0,OPT_BIND }, \
+                { "rto-max",1,0,OPT_RTO_MAX }, \
+                { "path-max-retrans",1,0,OPT_PATH_MAX_RETRANS }, \
+                { "sched",1,0,OPT_SCHED }, \
+                { "unordered",0,0,OPT_UNORDERED }, \
+                { "pr",1,0,OPT_PR }, \
+                { "interleave",0,0,OPT_INTERLEAVE }
+
+/**
+ * Value for SO_BUSY_POLL in busy poll mode, in microseconds.
+ */
+#define BUSY_POLL_USEC 50
+
 struct common_context {
         int sock; /**< SCTP socket */
         flags_t options; /**< Runtime options */
         struct sctp_initmsg *initmsg; /**< Association parameters, if set */
         struct auth_context *actx; /**< Authentication parameters, if set */
+        uint64_t interval_ns; /**< Interval for statistics reports */
+        uint16_t batch; /**< Messages per sendmmsg()/recvmmsg(), 0 for none */
+        int engine; /**< I/O engine, ENGINE_CLASSIC or ENGINE_URING */
+        struct sock_tuning tuning; /**< Socket options to set */
+        int cpu; /**< CPU to pin the I/O thread to, -1 for none */
+        struct addr_set laddrs; /**< Local addresses to bind to, empty for any */
+        struct send_policy send; /**< Delivery options of the messages sent */
+        int tuning_printed; /**< 1 once the socket options have been printed */
 };
 
+/**
+ * I/O with the synchronous system calls.
+ */
+#define ENGINE_CLASSIC 0
+/**
+ * I/O with io_uring (available if compiled with HAVE_URING).
+ */
+#define ENGINE_URING 1
+
 /*
  * common operation flags
  */
@@ -94,21 +277,54 @@ struct common_context {
  */
 #define AUTH_FLAG 0x01 << 5
 
+/**
+ * Flag indicating that statistics should be reported periodically instead
+ * of printing information about each message.
+ */
+#define REPORT_FLAG 0x01 << 6
+
+/**
+ * Flag indicating that the receive loop should spin on non-blocking reads
+ * instead of sleeping.
+ */
+#define BUSY_POLL_FLAG 0x01 << 7
+
 
 flags_t set_flag( flags_t flags, flags_t set );
 int is_flag( flags_t flags, flags_t set );
 flags_t unset_flag( flags_t flags, flags_t set );
 
+/**
+ * Number of nanoseconds in second.
+ */
+#define NSEC_PER_SEC 1000000000ULL
+
+uint64_t time_now_ns( void );
+
 int resolve( char *addr, struct sockaddr_storage *ss );
+int addr_set_add( struct addr_set *set, char *addr );
+int common_bindx( int sock, struct addr_set *set, uint16_t port );
+int common_connectx( int sock, struct addr_set *set, uint16_t port );
 int parse_uint16( char *str, uint16_t *dst );
 int parse_uint32(char *str, uint32_t *dst );
+int parse_rate( char *str, uint64_t *dst );
+int parse_interval( char *str, uint64_t *dst );
 
-int sendit( int sock, uint32_t ppid, uint16_t streamno,
+int sendit( int sock, uint32_t ppid, uint16_t streamno, uint32_t context,
                 struct sockaddr *dst, size_t dst_len,
                 uint8_t *chunk, int chunk_size );
+ssize_t sendit_iov( int sock, uint32_t ppid, uint16_t streamno, 
+                uint32_t context, struct sockaddr *dst, size_t dst_len,
+                struct iovec *iov, int iovcnt, int flags );
+int recv_spin( int sock, time_t timeout_ms, uint8_t *chunk, size_t chunk_len,
+                struct sockaddr *peer, socklen_t *peerlen,
+                struct sctp_sndrcvinfo *info, int *flags );
 int recv_wait( int sock, time_t timeout_ms, uint8_t *chunk, size_t chunk_len,
                 struct sockaddr *peer, socklen_t *peerlen, struct sctp_sndrcvinfo *info,
                 int *flags );
+void set_sndinfo_cmsg( struct msghdr *msg, uint8_t *cbuf, uint32_t ppid,
+                uint16_t streamno, uint32_t context );
+int get_rcvinfo_cmsg( struct cmsghdr *cmsg, struct sctp_sndrcvinfo *info );
 void print_error( const char *msg, int num );
 int subscribe_to_events( int sock );
 void print_ss( struct sockaddr_storage *ss );
@@ -117,9 +333,14 @@ void print_input( struct sockaddr_storage *from, int len, int flags,
 void print_output( struct sockaddr_storage *to, int len);
 void print_output_verbose( struct sockaddr_storage *to, int len,
                 uint32_t ppid, uint16_t streamno);
+void print_progress( uint32_t n, uint32_t count );
 
 int common_parse_args(int c, char *optarg, struct common_context *ctx);
 void common_print_usage();
 void common_deinit(struct common_context *ctx);
 int common_init(struct common_context *ctx);
+int common_create_socket(struct common_context *ctx);
+void common_print_tuning(struct common_context *ctx, int sock);
+void common_start_output(struct common_context *ctx);
+void common_prepare_io(struct common_context *ctx, int offset);
 #endif /* _COMMON_H_ */
@@ -119,6 +119,16 @@ struct dbg_module_info dbg_modules[] = {
         {"EVENTS",DEBUG_DEFAULT_LEVEL},
         {"AUTH",DEBUG_DEFAULT_LEVEL},
         {"COMMON",DEBUG_DEFAULT_LEVEL},
+        {"PACING",DEBUG_DEFAULT_LEVEL},
+        {"HISTOGRAM",DEBUG_DEFAULT_LEVEL},
+        {"STATS",DEBUG_DEFAULT_LEVEL},
+        {"PAYLOAD",DEBUG_DEFAULT_LEVEL},
+        {"BATCH",DEBUG_DEFAULT_LEVEL},
+        {"URING",DEBUG_DEFAULT_LEVEL},
+        {"REASM",DEBUG_DEFAULT_LEVEL},
+        {"OUTLOG",DEBUG_DEFAULT_LEVEL},
+        {"FAILOVER",DEBUG_DEFAULT_LEVEL},
+        {"STREAMS",DEBUG_DEFAULT_LEVEL},
         {"GENERIC",DEBUG_DEFAULT_LEVEL},
 };
 #endif /* DPRINT_MODULE */
@@ -71,6 +71,16 @@ enum dbg_module {
         DBG_MODULE_EVENTS,
         DBG_MODULE_AUTH,
         DBG_MODULE_COMMON,
+        DBG_MODULE_PACING,
+        DBG_MODULE_HISTOGRAM,
+        DBG_MODULE_STATS,
+        DBG_MODULE_PAYLOAD,
+        DBG_MODULE_BATCH,
+        DBG_MODULE_URING,
+        DBG_MODULE_REASM,
+        DBG_MODULE_OUTLOG,
+        DBG_MODULE_FAILOVER,
+        DBG_MODULE_STREAMS,
         DBG_MODULE_GENERIC /* this should always be the last */
 };
 #endif /* DPRINT_MODULE */
@@ -98,4 +108,12 @@ enum dbg_module {
 #define SOL_SCTP 132
 #endif /* FREEBSD */
 
+#ifndef FREEBSD
+/**
+ * epoll(7) is available, the server can handle multiple connections
+ * on a single event loop.
+ */
+#define HAVE_EPOLL
+#endif /* FREEBSD */
+
 #endif /* _DEFS_H_ */
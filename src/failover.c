@@ -0,0 +1,303 @@
+/**
+ * @file failover.c - Path failover measurement
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_FAILOVER
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "failover.h"
+
+/**
+ * Size of the buffer used to read the events, data is discarded.
+ */
+#define FAILOVER_BUF_SIZE 2048
+
+/**
+ * Milliseconds since the measurement started.
+ */
+#define FO_MS(fo, ns) ((double)((ns) - (fo)->start_ns) / 1000000.0)
+
+/**
+ * Print the addresses of the peer and the primary path.
+ *
+ * @param sock The socket of the association.
+ */
+static void print_paths( int sock )
+{
+        struct sockaddr *addrs;
+        struct sctp_prim prim;
+        struct sockaddr_storage ss;
+        socklen_t len;
+        uint8_t *ptr;
+        int cnt, i;
+
+        cnt = sctp_getpaddrs( sock, 0, &addrs );
+        if ( cnt <= 0 ) {
+                DBG("Unable to get the peer addresses\n");
+                return;
+        }
+        printf("Peer addresses:");
+        ptr = (uint8_t *)addrs;
+        for ( i = 0; i < cnt; i++ ) {
+                memset( &ss, 0, sizeof(ss));
+                if ( ((struct sockaddr *)ptr)->sa_family == AF_INET ) {
+                        memcpy( &ss, ptr, sizeof(struct sockaddr_in));
+                        ptr += sizeof(struct sockaddr_in);
+                } else {
+                        memcpy( &ss, ptr, sizeof(struct sockaddr_in6));
+                        ptr += sizeof(struct sockaddr_in6);
+                }
+                printf(" ");
+                print_ss( &ss );
+        }
+        sctp_freepaddrs( addrs );
+
+        memset( &prim, 0, sizeof(prim));
+        len = sizeof(prim);
+        if ( getsockopt( sock, IPPROTO_SCTP, SCTP_PRIMARY_ADDR, 
+                                &prim, &len ) == 0 ) {
+                /* the option structure is packed */
+                memcpy( &ss, &prim.ssp_addr, sizeof(ss));
+                printf(", primary ");
+                print_ss( &ss );
+        }
+        printf("\n");
+}
+
+/**
+ * Handle one notification read from the socket.
+ *
+ * @param fo The failover measurement.
+ * @param not The notification.
+ * @param now Current time.
+ */
+static void handle_notification( struct failover *fo, 
+                union sctp_notification *not, uint64_t now )
+{
+        struct sctp_paddr_change *spc;
+        struct sockaddr_storage ss;
+
+        if ( not->sn_header.sn_type == SCTP_ASSOC_CHANGE ) {
+                if ( not->sn_assoc_change.sac_state == SCTP_COMM_LOST )
+                        printf("[%.1f ms] Association lost\n", FO_MS(fo, now));
+                return;
+        }
+        if ( not->sn_header.sn_type != SCTP_PEER_ADDR_CHANGE ) {
+                TRACE("Ignoring event with type %d\n", not->sn_header.sn_type);
+                return;
+        }
+        spc = &not->sn_paddr_change;
+        __atomic_add_fetch( &fo->path_events, 1, __ATOMIC_RELAXED );
+        memcpy( &ss, &spc->spc_aaddr, sizeof(ss));
+        printf("[%.1f ms] Path ", FO_MS(fo, now));
+        print_ss( &ss );
+        switch( spc->spc_state ) {
+                case SCTP_ADDR_UNREACHABLE :
+                        printf(" unreachable\n");
+                        __atomic_store_n( &fo->down_ns, now, __ATOMIC_RELEASE );
+                        break;
+                case SCTP_ADDR_AVAILABLE :
+                        printf(" available\n");
+                        break;
+                case SCTP_ADDR_MADE_PRIM :
+                        printf(" made primary\n");
+                        break;
+                case SCTP_ADDR_CONFIRMED :
+                        printf(" confirmed\n");
+                        break;
+                default :
+                        printf(" changed state to %d\n", spc->spc_state);
+                        break;
+        }
+}
+
+/**
+ * Thread reading the events from the socket until stopped.
+ *
+ * Data possibly received is discarded.
+ *
+ * @param arg The failover measurement.
+ * @return NULL
+ */
+static void *event_thread( void *arg )
+{
+        struct failover *fo = (struct failover *)arg;
+        uint8_t buf[FAILOVER_BUF_SIZE];
+        struct pollfd fds[2];
+        struct msghdr msg;
+        struct iovec iov;
+        ssize_t ret;
+
+        fds[0].fd = fo->sock;
+        fds[0].events = POLLIN;
+        fds[1].fd = fo->stop_fd;
+        fds[1].events = POLLIN;
+        while ( 1 ) {
+                if ( poll( fds, 2, -1 ) < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+                        print_error("Error in poll()", errno);
+                        break;
+                }
+                if ( fds[1].revents != 0 )
+                        break;
+                if ( fds[0].revents & (POLLERR|POLLHUP) )
+                        break;
+
+                memset( &msg, 0, sizeof(msg));
+                iov.iov_base = buf;
+                iov.iov_len = sizeof(buf);
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                ret = recvmsg( fo->sock, &msg, MSG_DONTWAIT );
+                if ( ret == 0 ) 
+                        break;
+                if ( ret > 0 && (msg.msg_flags & MSG_NOTIFICATION))
+                        handle_notification( fo, 
+                                        (union sctp_notification *)buf, 
+                                        time_now_ns());
+        }
+        return NULL;
+}
+
+/**
+ * Start the failover measurement on the association.
+ *
+ * Subscribes to the peer address change events, prints the paths of
+ * the association and starts the thread reading the events.
+ *
+ * @param fo The failover measurement.
+ * @param sock The socket of the association.
+ * @param threshold_ns Gap between sends counted as a stall.
+ * @return -1 if the events can not be subscribed, 0 on success.
+ */
+int failover_start( struct failover *fo, int sock, uint64_t threshold_ns )
+{
+        struct sctp_event_subscribe event;
+
+        memset( fo, 0, sizeof(*fo));
+        memset( &event, 0, sizeof(event));
+        event.sctp_data_io_event = 1;
+        event.sctp_association_event = 1;
+        event.sctp_address_event = 1;
+        if ( setsockopt( sock, IPPROTO_SCTP, SCTP_EVENTS, 
+                                &event, sizeof(event)) < 0 ) {
+                print_error("Unable to subscribe to path events", errno);
+                return -1;
+        }
+        fo->sock = sock;
+        fo->threshold_ns = threshold_ns;
+        print_paths( sock );
+        fo->start_ns = time_now_ns();
+        fo->last_ns = fo->start_ns;
+
+        fo->stop_fd = eventfd( 0, EFD_CLOEXEC );
+        if ( fo->stop_fd < 0 ) {
+                print_error("Unable to create eventfd", errno);
+                return -1;
+        }
+        if ( pthread_create( &fo->thread, NULL, event_thread, fo ) != 0 ) {
+                fprintf(stderr, "Unable to start the path event thread\n");
+                close( fo->stop_fd );
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Account a completed send.
+ *
+ * Checks if the throughput stalled since the previous send, or since the
+ * send was due if the sends are paced. The planned gap between paced
+ * sends is not a stall.
+ *
+ * @param fo The failover measurement.
+ * @param due_ns Time the message was due to be sent, 0 if not paced.
+ */
+void failover_tick( struct failover *fo, uint64_t due_ns )
+{
+        uint64_t now, gap, down, since;
+
+        now = time_now_ns();
+        since = due_ns > fo->last_ns ? due_ns : fo->last_ns;
+        gap = now > since ? now - since : 0;
+        if ( gap >= fo->threshold_ns ) {
+                down = __atomic_load_n( &fo->down_ns, __ATOMIC_ACQUIRE );
+                fo->stalls++;
+                fo->total_ns += gap;
+                if ( gap > fo->max_ns )
+                        fo->max_ns = gap;
+                printf("[%.1f ms] Throughput stalled for %.1f ms", 
+                                FO_MS(fo, now), (double)gap / 1000000.0 );
+                if ( down >= since ) 
+                        printf(", path failure detected after %.1f ms",
+                                        (double)(down - since) / 1000000.0);
+                printf("\n");
+        }
+        fo->last_ns = now;
+}
+
+/**
+ * Stop the event thread and print the summary of the failover
+ * measurement.
+ *
+ * @param fo The failover measurement.
+ */
+void failover_final( struct failover *fo )
+{
+        uint64_t one = 1;
+
+        if ( write( fo->stop_fd, &one, sizeof(one)) < 0 ) 
+                print_error("Unable to stop the path event thread", errno);
+        else
+                pthread_join( fo->thread, NULL );
+        close( fo->stop_fd );
+        printf("Failover: %" PRIu32 " stalls, longest %.1f ms, total %.1f ms, "
+                        "%" PRIu32 " path changes\n", fo->stalls,
+                        (double)fo->max_ns / 1000000.0, 
+                        (double)fo->total_ns / 1000000.0, 
+                        __atomic_load_n( &fo->path_events, __ATOMIC_RELAXED ));
+}
@@ -0,0 +1,63 @@
+/**
+ * @file failover.h - Path failover measurement
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FAILOVER_H_
+#define _FAILOVER_H_
+
+/**
+ * State of the failover measurement.
+ *
+ * The stalls are detected by the send loop: a gap between two completed
+ * sends longer than the threshold is counted as a stall. With the send
+ * buffer full the sends block while no data gets acknowledged, so the gap
+ * is the time the throughput stalled. The path events are read by a
+ * separate thread to get their time right while the sender is blocked.
+ */
+struct failover {
+        int sock; /**< The socket of the association */
+        int stop_fd; /**< eventfd to stop the event thread */
+        pthread_t thread; /**< Thread reading the path events */
+        uint64_t threshold_ns; /**< Gap between sends counted as a stall */
+        uint64_t start_ns; /**< Time the measurement started */
+        uint64_t last_ns; /**< Time of the last completed send */
+        uint64_t down_ns; /**< Time a path was last reported unreachable */
+        uint64_t max_ns; /**< Longest stall */
+        uint64_t total_ns; /**< Total time stalled */
+        uint32_t stalls; /**< Number of stalls */
+        uint32_t path_events; /**< Number of path changes seen */
+};
+
+int failover_start( struct failover *fo, int sock, uint64_t threshold_ns );
+void failover_tick( struct failover *fo, uint64_t due_ns );
+void failover_final( struct failover *fo );
+
+#endif /* _FAILOVER_H_ */
@@ -0,0 +1,197 @@
+/**
+ * @file histogram.c - Log-bucketed latency histogram.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_HISTOGRAM
+#include "defs.h"
+#include "debug.h"
+#include "histogram.h"
+
+/**
+ * Create new, empty histogram.
+ * @return Pointer to the histogram.
+ */
+struct histogram *hist_create( void )
+{
+        struct histogram *h;
+
+        h = mem_alloc( sizeof(*h));
+        hist_reset( h );
+        return h;
+}
+
+/**
+ * Delete the histogram.
+ * @param h Pointer to the histogram.
+ */
+void hist_delete( struct histogram *h )
+{
+        mem_free( h );
+}
+
+/**
+ * Clear all the values from the histogram.
+ * @param h Pointer to the histogram.
+ */
+void hist_reset( struct histogram *h )
+{
+        memset( h, 0, sizeof(*h));
+        h->min = UINT64_MAX;
+}
+
+/**
+ * Get the index of the bucket for given value.
+ * @param value The value.
+ * @return Index to the counts array.
+ */
+static int hist_index( uint64_t value )
+{
+        int msb, shift;
+
+        if ( value < HIST_SUB_COUNT )
+                return (int)value;
+
+        msb = 63 - __builtin_clzll( value );
+        shift = msb - HIST_SUB_BITS + 1;
+        return shift * HIST_HALF_COUNT + (int)(value >> shift);
+}
+
+/**
+ * Get the largest value that is counted to the given bucket.
+ * @param idx Index of the bucket.
+ * @return The upper limit of the bucket.
+ */
+static uint64_t hist_value( int idx )
+{
+        int shift;
+
+        if ( idx < HIST_SUB_COUNT )
+                return (uint64_t)idx;
+
+        shift = (idx - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+        idx -= shift * HIST_HALF_COUNT;
+        return (((uint64_t)idx + 1) << shift) - 1;
+}
+
+/**
+ * Record a value to the histogram.
+ * @param h Pointer to the histogram.
+ * @param value The value to record.
+ */
+void hist_record( struct histogram *h, uint64_t value )
+{
+        h->counts[hist_index(value)]++;
+        h->total++;
+        h->sum += value;
+        if ( value < h->min )
+                h->min = value;
+        if ( value > h->max )
+                h->max = value;
+}
+
+/**
+ * Add all values from one histogram to another.
+ * @param dst The histogram where the values are added.
+ * @param src The histogram whose values to add.
+ */
+void hist_merge( struct histogram *dst, struct histogram *src )
+{
+        int i;
+
+        for ( i = 0; i < HIST_BUCKETS; i++ )
+                dst->counts[i] += src->counts[i];
+
+        dst->total += src->total;
+        dst->sum += src->sum;
+        if ( src->min < dst->min )
+                dst->min = src->min;
+        if ( src->max > dst->max )
+                dst->max = src->max;
+}
+
+/**
+ * Get the value at given percentile.
+ *
+ * @param h Pointer to the histogram.
+ * @param percentile The percentile (0 - 100).
+ * @return The value below or equal to which the given percentage of the
+ * values are, 0 if the histogram is empty.
+ */
+uint64_t hist_percentile( struct histogram *h, double percentile )
+{
+        uint64_t target, count = 0;
+        int i;
+
+        if ( h->total == 0 )
+                return 0;
+
+        target = (uint64_t)((percentile / 100.0) * h->total + 0.5);
+        if ( target == 0 )
+                target = 1;
+        if ( target >= h->total )
+                return h->max;
+
+        for ( i = 0; i < HIST_BUCKETS; i++ ) {
+                count += h->counts[i];
+                if ( count >= target ) 
+                        return hist_value(i) < h->max ? hist_value(i) : h->max;
+        }
+        return h->max;
+}
+
+/**
+ * Print the percentiles of the histogram, in microseconds.
+ *
+ * @param fp The file where to print.
+ * @param label Label to print in front of the values.
+ * @param h Pointer to the histogram.
+ */
+void hist_print( FILE *fp, const char *label, struct histogram *h )
+{
+        if ( h->total == 0 ) {
+                fprintf(fp, "%s: no samples\n", label);
+                return;
+        }
+        fprintf(fp, "%s: n %" PRIu64 " min %.1f avg %.1f p50 %.1f p90 %.1f "
+                        "p99 %.1f p99.9 %.1f max %.1f us\n", label, h->total,
+                        h->min / 1000.0, 
+                        (double)h->sum / h->total / 1000.0,
+                        hist_percentile(h, 50.0) / 1000.0,
+                        hist_percentile(h, 90.0) / 1000.0,
+                        hist_percentile(h, 99.0) / 1000.0,
+                        hist_percentile(h, 99.9) / 1000.0,
+                        h->max / 1000.0 );
+}
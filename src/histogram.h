@@ -0,0 +1,77 @@
+/**
+ * @file histogram.h - Log-bucketed latency histogram.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+/**
+ * Number of bits used for the sub-buckets. Each power of two range is
+ * divided into 2^(HIST_SUB_BITS-1) buckets, giving relative error less than
+ * 1/2^(HIST_SUB_BITS-1).
+ */
+#define HIST_SUB_BITS 8
+/**
+ * Number of sub-buckets on the first, linear, range.
+ */
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+/**
+ * Number of sub-buckets on each following range.
+ */
+#define HIST_HALF_COUNT (1 << (HIST_SUB_BITS - 1))
+/**
+ * Total number of buckets needed to cover 64-bit values.
+ */
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS) * HIST_HALF_COUNT + HIST_SUB_COUNT)
+
+/**
+ * HDR-style histogram for recording latencies (in nanoseconds). 
+ *
+ * The values are counted on logarithmic buckets, each power of two range
+ * having the same number of linear sub-buckets.
+ */
+struct histogram {
+        uint64_t counts[HIST_BUCKETS]; /**< Counts for each bucket */
+        uint64_t total; /**< Number of values recorded */
+        uint64_t min; /**< Smallest value recorded */
+        uint64_t max; /**< Largest value recorded */
+        uint64_t sum; /**< Sum of the recorded values */
+};
+
+struct histogram *hist_create( void );
+void hist_delete( struct histogram *h );
+void hist_reset( struct histogram *h );
+void hist_record( struct histogram *h, uint64_t value );
+void hist_merge( struct histogram *dst, struct histogram *src );
+uint64_t hist_percentile( struct histogram *h, double percentile );
+void hist_print( FILE *fp, const char *label, struct histogram *h );
+
+#endif /* _HISTOGRAM_H_ */
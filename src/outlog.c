@@ -0,0 +1,507 @@
+/**
+ * @file outlog.c - Asynchronous per-message console output.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+#include <arpa/inet.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_OUTLOG
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "outlog.h"
+
+/**
+ * Single producer, single consumer ring of records. 
+ *
+ * Each thread printing messages gets its own ring, the writer thread is
+ * the only consumer.
+ */
+struct outlog_ring {
+        struct outlog_record recs[OUTLOG_RING_SIZE]; /**< The records */
+        uint32_t head; /**< Next record to write, updated by producer */
+        uint32_t tail; /**< Next record to read, updated by writer */
+        uint64_t dropped; /**< Records dropped as the ring was full */
+        uint64_t reported; /**< Dropped records reported by writer */
+        struct outlog_ring *next; /**< Next ring on the list */
+};
+
+/**
+ * State of the output pipeline.
+ */
+static struct {
+        int running; /**< 1 if the records are passed to the writer */
+        int stop; /**< Set to request the writer to stop */
+        int idle; /**< Set by the writer before it blocks on wake_fd */
+        int wake_fd; /**< eventfd the writer blocks on when idle */
+        pthread_t writer; /**< The writer thread */
+        pthread_mutex_t lock; /**< Protects the ring list */
+        struct outlog_ring *rings; /**< Rings of all the producer threads */
+        char buf[OUTLOG_WRITE_BUF]; /**< Buffer for the formatted records */
+        size_t buf_len; /**< Number of bytes on buffer */
+} outlog = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake_fd = -1 };
+
+/**
+ * Ring of the calling thread.
+ */
+static __thread struct outlog_ring *my_ring;
+
+/**
+ * Get the ring of the calling thread, creating it on first use.
+ */
+static struct outlog_ring *outlog_ring()
+{
+        struct outlog_ring *r = my_ring;
+
+        if ( r != NULL )
+                return r;
+
+        r = mem_zalloc( sizeof(*r));
+        pthread_mutex_lock( &outlog.lock );
+        r->next = outlog.rings;
+        __atomic_store_n( &outlog.rings, r, __ATOMIC_RELEASE );
+        pthread_mutex_unlock( &outlog.lock );
+        my_ring = r;
+        return r;
+}
+
+/**
+ * Reserve the next record on the ring of the calling thread.
+ *
+ * @return The record to fill, NULL if the ring is full.
+ */
+static struct outlog_record *outlog_reserve( struct outlog_ring **rp )
+{
+        struct outlog_ring *r = outlog_ring();
+        uint32_t head = r->head;
+
+        *rp = r;
+        if ( head - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE ) == 
+                        OUTLOG_RING_SIZE ) {
+                __atomic_store_n( &r->dropped, r->dropped + 1, __ATOMIC_RELAXED );
+                return NULL;
+        }
+        return &r->recs[head & (OUTLOG_RING_SIZE - 1)];
+}
+
+/**
+ * Wake up the writer blocked on wake_fd.
+ */
+static void outlog_wake()
+{
+        uint64_t one = 1;
+
+        if ( write( outlog.wake_fd, &one, sizeof(one)) < 0 )
+                print_error("Unable to wake the output writer", errno);
+}
+
+/**
+ * Pass the reserved record to the writer, waking it up if it is idle.
+ *
+ * The writer sets idle before checking the rings for the last time, so
+ * either it sees the record or we see it idle.
+ */
+static void outlog_commit( struct outlog_ring *r )
+{
+        __atomic_store_n( &r->head, r->head + 1, __ATOMIC_SEQ_CST );
+        if ( __atomic_load_n( &outlog.idle, __ATOMIC_SEQ_CST ) &&
+                        __atomic_exchange_n( &outlog.idle, 0, __ATOMIC_SEQ_CST ))
+                outlog_wake();
+}
+
+/**
+ * Copy the peer address to the record.
+ */
+static void outlog_set_peer( struct outlog_record *rec, 
+                struct sockaddr_storage *ss )
+{
+        if ( ss->ss_family == AF_INET ) 
+                memcpy( &rec->peer, ss, sizeof(struct sockaddr_in));
+        else 
+                memcpy( &rec->peer, ss, sizeof(struct sockaddr_in6));
+}
+
+/**
+ * Append formatted text to the write buffer.
+ */
+static void outlog_append( const char *fmt, ... )
+        __attribute__((format(printf, 1, 2)));
+
+static void outlog_append( const char *fmt, ... )
+{
+        va_list ap;
+        int n;
+
+        va_start( ap, fmt );
+        n = vsnprintf( outlog.buf + outlog.buf_len, 
+                        sizeof(outlog.buf) - outlog.buf_len, fmt, ap );
+        va_end( ap );
+        if ( n > 0 ) 
+                outlog.buf_len += n;
+        if ( outlog.buf_len >= sizeof(outlog.buf))
+                outlog.buf_len = sizeof(outlog.buf) - 1; /* truncated */
+}
+
+/**
+ * Format the peer address like print_ss() does.
+ */
+static void outlog_append_peer( struct sockaddr_in6 *peer )
+{
+        char peername[INET6_ADDRSTRLEN];
+        struct sockaddr_in *sin = (struct sockaddr_in *)peer;
+
+        if ( peer->sin6_family == AF_INET ) {
+                if ( inet_ntop( AF_INET, &sin->sin_addr, peername, 
+                                        sizeof(peername)) == NULL )
+                        strcpy( peername, "??" );
+                outlog_append( "%s:%d", peername, ntohs(sin->sin_port));
+        } else {
+                if ( inet_ntop( AF_INET6, &peer->sin6_addr, peername, 
+                                        sizeof(peername)) == NULL )
+                        strcpy( peername, "??" );
+                outlog_append( "%s:%d", peername, ntohs(peer->sin6_port));
+        }
+}
+
+/**
+ * Format the record to the write buffer, the output is identical to the
+ * one of print_input(), print_output_verbose() and print_progress().
+ */
+static void outlog_format( struct outlog_record *rec )
+{
+        if ( rec->type == OUTLOG_PROGRESS ) {
+                outlog_append( "Sending chunk %" PRIu32 "/%" PRIu32 " \n", 
+                                (uint32_t)rec->len, rec->context );
+        } else if ( rec->type == OUTLOG_INPUT ) {
+                outlog_append( "< " );
+                outlog_append_peer( &rec->peer );
+                outlog_append( " (%d bytes) %s\n", rec->len, 
+                                (rec->flags & OUTLOG_PARTIAL) ? "[partial]" : "" );
+                if ( rec->flags & OUTLOG_INFO ) {
+                        outlog_append( "\t stream: %d ppid: %d context: %d\n",
+                                        rec->stream, rec->ppid, rec->context );
+                        outlog_append( "\t ssn: %d tsn: %u cumtsn: %u [%sordered]\n",
+                                        rec->ssn, rec->tsn, rec->cumtsn, 
+                                        (rec->flags & OUTLOG_UNORDERED) ? "un" : "" );
+                }
+        } else {
+                outlog_append( "> " );
+                outlog_append_peer( &rec->peer );
+                outlog_append( " (%d bytes)\n", rec->len );
+                if ( rec->flags & OUTLOG_INFO ) 
+                        outlog_append( "\t stream: %d ppid: %d\n",
+                                        rec->stream, rec->ppid );
+        }
+}
+
+/**
+ * Write the formatted records to stdout.
+ */
+static void outlog_flush()
+{
+        if ( outlog.buf_len == 0 )
+                return;
+
+        fwrite( outlog.buf, 1, outlog.buf_len, stdout );
+        fflush( stdout );
+        outlog.buf_len = 0;
+}
+
+/**
+ * Move the records from all the rings to the write buffer, writing the
+ * buffer whenever it fills up.
+ *
+ * @return Number of records handled.
+ */
+static int outlog_drain()
+{
+        struct outlog_ring *r;
+        uint32_t head, tail;
+        uint64_t dropped;
+        int n = 0;
+
+        for ( r = __atomic_load_n( &outlog.rings, __ATOMIC_ACQUIRE ); 
+                        r != NULL; r = r->next ) {
+                head = __atomic_load_n( &r->head, __ATOMIC_SEQ_CST );
+                for ( tail = r->tail; tail != head; tail++ ) {
+                        /* the longest record fits to 512 bytes */
+                        if ( sizeof(outlog.buf) - outlog.buf_len < 512 )
+                                outlog_flush();
+                        outlog_format( &r->recs[tail & (OUTLOG_RING_SIZE - 1)] );
+                        n++;
+                }
+                __atomic_store_n( &r->tail, tail, __ATOMIC_RELEASE );
+
+                dropped = __atomic_load_n( &r->dropped, __ATOMIC_RELAXED );
+                if ( dropped != r->reported ) {
+                        outlog_append( "[%" PRIu64 " output records dropped]\n",
+                                        dropped - r->reported );
+                        r->reported = dropped;
+                }
+        }
+        outlog_flush();
+        return n;
+}
+
+/**
+ * Main function of the writer thread.
+ *
+ * When the rings are empty the writer blocks on wake_fd until a producer
+ * commits a record or outlog_stop() is called.
+ */
+static void *outlog_writer( void *arg )
+{
+        uint64_t val;
+
+        (void)arg;
+
+        while ( !__atomic_load_n( &outlog.stop, __ATOMIC_ACQUIRE )) {
+                if ( outlog_drain() > 0 ) 
+                        continue;
+
+                __atomic_store_n( &outlog.idle, 1, __ATOMIC_SEQ_CST );
+                if ( outlog_drain() > 0 ) {
+                        /* a producer may have woken us already, then the
+                         * next read just returns at once */
+                        __atomic_store_n( &outlog.idle, 0, __ATOMIC_SEQ_CST );
+                        continue;
+                }
+                if ( read( outlog.wake_fd, &val, sizeof(val)) < 0 && 
+                                errno != EINTR ) {
+                        print_error("Unable to wait for output records", errno);
+                        break;
+                }
+        }
+        outlog_drain();
+        return NULL;
+}
+
+/**
+ * In the child process after fork() there is no writer thread, the
+ * records are printed directly unless outlog_start() is called again.
+ */
+static void outlog_forked()
+{
+        outlog.running = 0;
+        outlog.stop = 0;
+        outlog.idle = 0;
+        if ( outlog.wake_fd >= 0 ) {
+                close( outlog.wake_fd );
+                outlog.wake_fd = -1;
+        }
+        outlog.rings = NULL;
+        outlog.buf_len = 0;
+        my_ring = NULL;
+        pthread_mutex_init( &outlog.lock, NULL );
+}
+
+/**
+ * Start the writer thread. 
+ *
+ * After this print_input(), print_output() and print_output_verbose() only
+ * pass the information to the writer, which formats and writes it. If the
+ * writer can not keep up, the records are dropped and the number of
+ * dropped records is printed.
+ *
+ * @return -1 if the writer thread could not be started, 0 on success.
+ */
+int outlog_start()
+{
+        static int registered = 0;
+
+        if ( outlog.running )
+                return 0;
+
+        if ( !registered ) {
+                pthread_atfork( NULL, NULL, outlog_forked );
+                atexit( outlog_stop );
+                registered = 1;
+        }
+        outlog.stop = 0;
+        outlog.idle = 0;
+        outlog.wake_fd = eventfd( 0, EFD_CLOEXEC );
+        if ( outlog.wake_fd < 0 ) {
+                print_error("Unable to create eventfd", errno);
+                return -1;
+        }
+        errno = pthread_create( &outlog.writer, NULL, outlog_writer, NULL );
+        if ( errno != 0 ) {
+                print_error("Unable to start output thread", errno);
+                close( outlog.wake_fd );
+                outlog.wake_fd = -1;
+                return -1;
+        }
+        outlog.running = 1;
+        return 0;
+}
+
+/**
+ * Write all the pending records and stop the writer thread.
+ *
+ * The rings are released, so no thread may print messages after this.
+ */
+void outlog_stop()
+{
+        struct outlog_ring *r;
+
+        if ( !outlog.running )
+                return;
+
+        outlog.running = 0;
+        __atomic_store_n( &outlog.stop, 1, __ATOMIC_RELEASE );
+        outlog_wake();
+        pthread_join( outlog.writer, NULL );
+        close( outlog.wake_fd );
+        outlog.wake_fd = -1;
+
+        while ( outlog.rings != NULL ) {
+                r = outlog.rings;
+                outlog.rings = r->next;
+                mem_free( r );
+        }
+        my_ring = NULL;
+}
+
+/**
+ * Pass information about received message to the writer.
+ *
+ * @param from Pointer to the address of the peer.
+ * @param len Number of bytes received.
+ * @param flags The flags of the received message.
+ * @param info Pointer to the sndrcvinfo to print, NULL if none.
+ * @return -1 if the writer is not running and the message should be
+ * printed directly, 0 otherwise.
+ */
+int outlog_input( struct sockaddr_storage *from, int len, int flags, 
+                struct sctp_sndrcvinfo *info )
+{
+        struct outlog_record *rec;
+        struct outlog_ring *r;
+
+        if ( !outlog.running )
+                return -1;
+
+        rec = outlog_reserve( &r );
+        if ( rec == NULL )
+                return 0;
+
+        rec->type = OUTLOG_INPUT;
+        rec->flags = (flags & MSG_EOR) ? 0 : OUTLOG_PARTIAL;
+        rec->len = len;
+        outlog_set_peer( rec, from );
+        if ( info != NULL ) {
+                rec->flags |= OUTLOG_INFO;
+                if ( info->sinfo_flags & SCTP_UNORDERED ) 
+                        rec->flags |= OUTLOG_UNORDERED;
+                rec->stream = info->sinfo_stream;
+                rec->ssn = info->sinfo_ssn;
+                rec->ppid = info->sinfo_ppid;
+                rec->context = info->sinfo_context;
+                rec->tsn = info->sinfo_tsn;
+                rec->cumtsn = info->sinfo_cumtsn;
+        }
+        outlog_commit( r );
+        return 0;
+}
+
+/**
+ * Pass information about sent message to the writer.
+ *
+ * @param to Pointer to the address of the peer.
+ * @param len Number of bytes sent.
+ * @param verbose 1 if the PPID and stream should be printed.
+ * @param ppid PPID of the message.
+ * @param streamno Stream the message was sent to.
+ * @return -1 if the writer is not running and the message should be
+ * printed directly, 0 otherwise.
+ */
+int outlog_output( struct sockaddr_storage *to, int len, int verbose,
+                uint32_t ppid, uint16_t streamno )
+{
+        struct outlog_record *rec;
+        struct outlog_ring *r;
+
+        if ( !outlog.running )
+                return -1;
+
+        rec = outlog_reserve( &r );
+        if ( rec == NULL )
+                return 0;
+
+        rec->type = OUTLOG_OUTPUT;
+        rec->flags = verbose ? OUTLOG_INFO : 0;
+        rec->len = len;
+        rec->ppid = ppid;
+        rec->stream = streamno;
+        outlog_set_peer( rec, to );
+        outlog_commit( r );
+        return 0;
+}
+
+/**
+ * Pass the progress of the sends to the writer.
+ *
+ * @param n Number of the message being sent, starting from 1.
+ * @param count Total number of messages to send.
+ * @return -1 if the writer is not running and the progress should be
+ * printed directly, 0 otherwise.
+ */
+int outlog_progress( uint32_t n, uint32_t count )
+{
+        struct outlog_record *rec;
+        struct outlog_ring *r;
+
+        if ( !outlog.running )
+                return -1;
+
+        rec = outlog_reserve( &r );
+        if ( rec == NULL )
+                return 0;
+
+        rec->type = OUTLOG_PROGRESS;
+        rec->flags = 0;
+        rec->len = (int32_t)n;
+        rec->context = count;
+        outlog_commit( r );
+        return 0;
+}
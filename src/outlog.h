@@ -0,0 +1,84 @@
+/**
+ * @file outlog.h - Asynchronous per-message console output.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _OUTLOG_H_
+#define _OUTLOG_H_
+
+/**
+ * Number of records on the ring of each producer thread, power of two.
+ */
+#define OUTLOG_RING_SIZE 4096
+
+/**
+ * Size of the buffer the writer formats the records to before writing.
+ */
+#define OUTLOG_WRITE_BUF 65536
+
+/*
+ * Types of the output records.
+ */
+#define OUTLOG_INPUT 1
+#define OUTLOG_OUTPUT 2
+#define OUTLOG_PROGRESS 3
+
+/*
+ * Flags for the output records.
+ */
+#define OUTLOG_PARTIAL 0x01
+#define OUTLOG_INFO 0x01 << 1
+#define OUTLOG_UNORDERED 0x01 << 2
+
+/**
+ * Information about one message to print.
+ */
+struct outlog_record {
+        uint8_t type; /**< OUTLOG_INPUT or OUTLOG_OUTPUT */
+        uint8_t flags; /**< OUTLOG_* flags */
+        uint16_t stream; /**< Stream of the message */
+        uint16_t ssn; /**< Stream sequence number (input only) */
+        int32_t len; /**< Number of bytes, or number of the message (progress only) */
+        uint32_t ppid; /**< PPID of the message */
+        uint32_t context; /**< Context (input only), or number of messages (progress only) */
+        uint32_t tsn; /**< TSN (input only) */
+        uint32_t cumtsn; /**< Cumulative TSN (input only) */
+        struct sockaddr_in6 peer; /**< The peer, AF_INET address fits here */
+};
+
+int outlog_start();
+void outlog_stop();
+int outlog_input( struct sockaddr_storage *from, int len, int flags, 
+                struct sctp_sndrcvinfo *info );
+int outlog_output( struct sockaddr_storage *to, int len, int verbose,
+                uint32_t ppid, uint16_t streamno );
+int outlog_progress( uint32_t n, uint32_t count );
+
+#endif /* _OUTLOG_H_ */
@@ -0,0 +1,180 @@
+/**
+ * @file pacing.c - Pacing of outgoing messages.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_PACING
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "pacing.h"
+
+/**
+ * Initialize the pacer with interval of num / den nanoseconds.
+ *
+ * @param p Pointer to the pacer.
+ * @param num Numerator for the interval.
+ * @param den Denominator for the interval.
+ * @param burst Maximum number of slots to catch up.
+ * @return -1 if the parameters are invalid, 0 on success.
+ */
+static int pacer_init( struct pacer *p, uint64_t num, uint64_t den,
+                uint32_t burst )
+{
+        if ( den == 0 || num == 0 )
+                return -1;
+
+        memset( p, 0, sizeof(*p));
+        p->step_ns = num / den;
+        p->step_rem = num % den;
+        p->step_den = den;
+        p->burst = burst > 0 ? burst : 1;
+        TRACE("Pacing with interval %" PRIu64 " + %" PRIu64 "/%" PRIu64 " ns\n",
+                        p->step_ns, p->step_rem, p->step_den );
+        return 0;
+}
+
+/**
+ * Initialize the pacer to send given number of messages per second.
+ *
+ * @param p Pointer to the pacer.
+ * @param msgs_per_sec The target message rate.
+ * @param burst Maximum number of slots to catch up.
+ * @return -1 if the parameters are invalid, 0 on success.
+ */
+int pacer_init_rate( struct pacer *p, uint64_t msgs_per_sec, uint32_t burst )
+{
+        return pacer_init( p, NSEC_PER_SEC, msgs_per_sec, burst );
+}
+
+/**
+ * Initialize the pacer to send payload with given bit rate.
+ *
+ * @param p Pointer to the pacer.
+ * @param bits_per_sec The target payload bandwidth.
+ * @param msg_size Size of each message in bytes.
+ * @param burst Maximum number of slots to catch up.
+ * @return -1 if the parameters are invalid, 0 on success.
+ */
+int pacer_init_bandwidth( struct pacer *p, uint64_t bits_per_sec, 
+                size_t msg_size, uint32_t burst )
+{
+        return pacer_init( p, NSEC_PER_SEC * 8 * msg_size, bits_per_sec, 
+                        burst );
+}
+
+/**
+ * Start the schedule, the first slot is at given time.
+ *
+ * @param p Pointer to the pacer.
+ * @param now The current time.
+ */
+void pacer_start( struct pacer *p, uint64_t now )
+{
+        p->next_ns = now;
+        p->acc = 0;
+}
+
+/**
+ * Get the time when next message is due. 
+ *
+ * If the sender has fallen behind more than burst slots, the schedule is
+ * moved forward so that only burst slots are due.
+ *
+ * @param p Pointer to the pacer.
+ * @param now The current time.
+ * @return Time of the next send slot, if it is not after now, the
+ * message can be sent immediately.
+ */
+uint64_t pacer_due( struct pacer *p, uint64_t now )
+{
+        uint64_t limit;
+
+        limit = p->step_ns * (p->burst - 1);
+        if ( now > p->next_ns && now - p->next_ns > limit ) {
+                TRACE("Sender behind the schedule, dropping slots\n");
+                p->next_ns = now - limit;
+                p->acc = 0;
+        }
+        return p->next_ns;
+}
+
+/**
+ * Consume the current slot and move to the next one.
+ *
+ * @param p Pointer to the pacer.
+ */
+void pacer_advance( struct pacer *p )
+{
+        p->next_ns += p->step_ns;
+        p->acc += p->step_rem;
+        if ( p->acc >= p->step_den ) {
+                p->next_ns++;
+                p->acc -= p->step_den;
+        }
+}
+
+/**
+ * Sleep until the next slot is due. 
+ *
+ * The slot is not consumed, call pacer_advance() after the message is
+ * sent.
+ *
+ * @param p Pointer to the pacer.
+ * @return -1 if sleep was interrupted, 0 when the slot is due.
+ */
+int pacer_wait( struct pacer *p )
+{
+        struct timespec ts;
+        uint64_t due;
+        int ret;
+
+        due = pacer_due( p, time_now_ns());
+        ts.tv_sec = due / NSEC_PER_SEC;
+        ts.tv_nsec = due % NSEC_PER_SEC;
+
+        ret = clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL );
+        if ( ret != 0 ) {
+                errno = ret;
+                return -1;
+        }
+        return 0;
+}
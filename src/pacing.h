@@ -0,0 +1,69 @@
+/**
+ * @file pacing.h - Pacing of outgoing messages.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PACING_H_
+#define _PACING_H_
+
+/**
+ * Default number of messages the pacer allows to be sent back-to-back to
+ * catch up the schedule.
+ */
+#define PACER_DEFAULT_BURST 16
+
+/**
+ * Context for pacing the sends. 
+ *
+ * Send slots are on fixed schedule, the interval between two slots is 
+ * step_ns + step_rem / step_den nanoseconds. The fractional part is
+ * accumulated so that the average rate is exact. If the sender falls behind
+ * the schedule, at most burst messages may be sent back-to-back to catch
+ * up, the rest of the lost slots are dropped (token bucket with depth of
+ * burst).
+ */
+struct pacer {
+        uint64_t next_ns; /**< Time of the next send slot */
+        uint64_t step_ns; /**< Whole nanoseconds between two slots */
+        uint64_t step_rem; /**< Fractional part of the interval */
+        uint64_t step_den; /**< Denominator for the fractional part */
+        uint64_t acc; /**< Accumulated fractional part */
+        uint32_t burst; /**< Maximum number of slots to catch up */
+};
+
+int pacer_init_rate( struct pacer *p, uint64_t msgs_per_sec, uint32_t burst );
+int pacer_init_bandwidth( struct pacer *p, uint64_t bits_per_sec, 
+                size_t msg_size, uint32_t burst );
+void pacer_start( struct pacer *p, uint64_t now );
+uint64_t pacer_due( struct pacer *p, uint64_t now );
+void pacer_advance( struct pacer *p );
+int pacer_wait( struct pacer *p );
+
+#endif /* _PACING_H_ */
@@ -0,0 +1,240 @@
+/**
+ * @file payload.c - Preloaded payload for the messages to send.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_PAYLOAD
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "payload.h"
+
+/**
+ * File for which the payload is generated with PRNG instead of reading it.
+ */
+#define PAYLOAD_RANDOM_FILE "/dev/urandom"
+
+/**
+ * Calculate the number of messages to keep in the ring.
+ *
+ * @param chunk_size Size of one message.
+ * @return Number of messages for the ring.
+ */
+static size_t ring_slots( size_t chunk_size )
+{
+        size_t slots;
+
+        slots = PAYLOAD_RING_BYTES / chunk_size;
+        if ( slots == 0 ) 
+                slots = 1;
+        else if ( slots > PAYLOAD_MAX_SLOTS )
+                slots = PAYLOAD_MAX_SLOTS;
+
+        return slots;
+}
+
+/**
+ * Fill the buffer with pseudo random data (xorshift64*).
+ *
+ * @param buf The buffer to fill.
+ * @param len Number of bytes to generate.
+ * @param seed Seed for the generator.
+ */
+static void fill_random( uint8_t *buf, size_t len, uint64_t seed )
+{
+        uint64_t x, r;
+        size_t n;
+
+        x = seed ? seed : 0x9e3779b97f4a7c15ULL;
+        while ( len > 0 ) {
+                x ^= x >> 12;
+                x ^= x << 25;
+                x ^= x >> 27;
+                r = x * 0x2545f4914f6cdd1dULL;
+                n = len < sizeof(r) ? len : sizeof(r);
+                memcpy( buf, &r, n );
+                buf += n;
+                len -= n;
+        }
+}
+
+/**
+ * Read the whole buffer from file. If the end of file is reached before
+ * the buffer is full, the data read so far is repeated to fill the buffer.
+ *
+ * @param fd The file to read.
+ * @param buf The buffer to fill.
+ * @param len Size of the buffer.
+ * @return -1 on error or if the file is empty, 0 on success.
+ */
+static int fill_from_file( int fd, uint8_t *buf, size_t len )
+{
+        size_t got = 0, n;
+        ssize_t ret;
+
+        while ( got < len ) {
+                ret = read( fd, buf + got, len - got );
+                if ( ret < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+                        return -1;
+                }
+                if ( ret == 0 )
+                        break;
+                got += ret;
+        }
+        if ( got == 0 ) {
+                errno = EINVAL;
+                return -1;
+        }
+        while ( got < len ) {
+                n = got < len - got ? got : len - got;
+                memcpy( buf + got, buf, n );
+                got += n;
+        }
+        return 0;
+}
+
+/**
+ * Initialize the payload pool. 
+ *
+ * @param pl Pointer to the payload pool.
+ * @param filename File to get the data from.
+ * @param chunk_size Size of one message.
+ * @return -1 on error (errno is set), 0 on success.
+ */
+int payload_init( struct payload *pl, const char *filename, size_t chunk_size )
+{
+        struct stat st;
+        uint64_t seed;
+        void *map;
+        int fd, ret = 0;
+
+        memset( pl, 0, sizeof(*pl));
+        if ( chunk_size == 0 ) {
+                errno = EINVAL;
+                return -1;
+        }
+        pl->chunk_size = chunk_size;
+
+        fd = open( filename, O_RDONLY );
+        if ( fd < 0 ) {
+                WARN("Can't open file %s : %s \n",filename, strerror(errno));
+                return -1;
+        }
+        if ( fstat( fd, &st ) < 0 ) {
+                close( fd );
+                return -1;
+        }
+
+        if ( S_ISREG( st.st_mode ) && (size_t)st.st_size >= chunk_size ) {
+                /* private writable mapping, the latency header may be written
+                 * to the messages */
+                map = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, 
+                                MAP_PRIVATE, fd, 0 );
+                if ( map != MAP_FAILED ) {
+                        pl->base = map;
+                        pl->map_len = st.st_size;
+                        pl->slots = st.st_size / chunk_size;
+                        TRACE("Mapped %zu messages from %s\n", pl->slots, filename);
+                        close( fd );
+                        return 0;
+                }
+                TRACE("Unable to map %s : %s \n", filename, strerror(errno));
+        }
+
+        pl->slots = ring_slots( chunk_size );
+        pl->base = mem_alloc( pl->slots * chunk_size );
+        if ( strcmp( filename, PAYLOAD_RANDOM_FILE ) == 0 ) {
+                ret = fill_from_file( fd, (uint8_t *)&seed, sizeof(seed));
+                if ( ret == 0 ) {
+                        fill_random( pl->base, pl->slots * chunk_size, seed );
+                        TRACE("Generated %zu random messages\n", pl->slots);
+                }
+        } else {
+                ret = fill_from_file( fd, pl->base, pl->slots * chunk_size );
+                TRACE("Read %zu messages from %s\n", pl->slots, filename );
+        }
+        close( fd );
+        if ( ret < 0 ) {
+                mem_free( pl->base );
+                pl->base = NULL;
+        }
+        return ret;
+}
+
+/**
+ * Get the next message from the pool. 
+ *
+ * @param pl Pointer to the payload pool.
+ * @return Pointer to chunk_size bytes of data. The data may be modified
+ * but the modifications will be visible when the message is used again.
+ */
+uint8_t *payload_next( struct payload *pl )
+{
+        uint8_t *msg;
+
+        msg = pl->base + pl->next * pl->chunk_size;
+        if ( ++pl->next == pl->slots )
+                pl->next = 0;
+
+        return msg;
+}
+
+/**
+ * Release the resources allocated for the payload pool.
+ *
+ * @param pl Pointer to the payload pool.
+ */
+void payload_free( struct payload *pl )
+{
+        if ( pl->base == NULL )
+                return;
+
+        if ( pl->map_len > 0 ) 
+                munmap( pl->base, pl->map_len );
+        else
+                mem_free( pl->base );
+        pl->base = NULL;
+}
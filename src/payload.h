@@ -0,0 +1,68 @@
+/**
+ * @file payload.h - Preloaded payload for the messages to send.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PAYLOAD_H_
+#define _PAYLOAD_H_
+
+/**
+ * Maximum number of bytes generated or read for the payload ring.
+ */
+#define PAYLOAD_RING_BYTES (4 * 1024 * 1024)
+
+/**
+ * Maximum number of messages in the payload ring.
+ */
+#define PAYLOAD_MAX_SLOTS 256
+
+/**
+ * Pool of preloaded messages to send.
+ *
+ * The payload is loaded once when the pool is initialized and the sender
+ * only takes the next message of chunk_size bytes from the pool. Regular
+ * files are mapped to memory and sent as consecutive slices, random data
+ * is generated into a ring with a userspace PRNG and other files are read
+ * once into a ring. Once the end of the pool is reached, the messages are
+ * repeated from the beginning.
+ */
+struct payload {
+        uint8_t *base; /**< Start of the payload data */
+        size_t chunk_size; /**< Size of one message */
+        size_t slots; /**< Number of messages in the pool */
+        size_t next; /**< Index of the next message */
+        size_t map_len; /**< Length of the mapping, 0 if base is allocated */
+};
+
+int payload_init( struct payload *pl, const char *filename, size_t chunk_size );
+uint8_t *payload_next( struct payload *pl );
+void payload_free( struct payload *pl );
+
+#endif /* _PAYLOAD_H_ */
@@ -0,0 +1,277 @@
+/**
+ * @file reasm.c - Reassembly of partial messages per association and stream.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_REASM
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "reasm.h"
+
+/**
+ * Get the home slot for the key.
+ */
+static uint32_t reasm_slot( struct reasm_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream )
+{
+        uint32_t h;
+
+        h = (uint32_t)assoc_id * 0x9e3779b1 ^ (uint32_t)stream * 0x85ebca77;
+        h ^= h >> 16;
+        return h & (t->size - 1);
+}
+
+/**
+ * Find the slot holding the key.
+ *
+ * @return Index of the slot, or index of the first free slot on the probe
+ * sequence if the key was not found.
+ */
+static uint32_t reasm_find( struct reasm_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream )
+{
+        uint32_t i;
+
+        i = reasm_slot( t, assoc_id, stream );
+        while ( t->entries[i].used ) {
+                if ( t->entries[i].assoc_id == assoc_id && 
+                                t->entries[i].stream == stream )
+                        break;
+                i = (i + 1) & (t->size - 1);
+        }
+        return i;
+}
+
+/**
+ * Double the size of the table.
+ */
+static void reasm_grow( struct reasm_table *t )
+{
+        struct reasm_entry *old = t->entries;
+        uint32_t old_size = t->size, i, j;
+
+        t->size = old_size * 2;
+        t->entries = mem_zalloc( t->size * sizeof(*t->entries));
+        for ( i = 0; i < old_size; i++ ) {
+                if ( !old[i].used )
+                        continue;
+                j = reasm_find( t, old[i].assoc_id, old[i].stream );
+                t->entries[j] = old[i];
+        }
+        mem_free( old );
+        TRACE("Reassembly table grown to %u slots\n", t->size );
+}
+
+/**
+ * Release the slot, returning its buffer to the pool.
+ *
+ * The following entries on the same probe sequence are shifted back so
+ * that no tombstones are needed.
+ */
+static void reasm_remove( struct reasm_table *t, uint32_t i )
+{
+        uint32_t j, k, mask = t->size - 1;
+
+        partial_store_free( &t->entries[i].store );
+        t->count--;
+
+        j = i;
+        while ( 1 ) {
+                j = (j + 1) & mask;
+                if ( !t->entries[j].used )
+                        break;
+                k = reasm_slot( t, t->entries[j].assoc_id, 
+                                t->entries[j].stream );
+                /* move unless the home slot is cyclically in (i, j] */
+                if ( i <= j ? (k <= i || k > j) : (k <= i && k > j) ) {
+                        t->entries[i] = t->entries[j];
+                        i = j;
+                }
+        }
+        memset( &t->entries[i], 0, sizeof(t->entries[i]));
+}
+
+/**
+ * Initialize the reassembly table.
+ *
+ * @param t Pointer to the table.
+ * @param by_stream 1 if the messages should be keyed also by stream (the
+ * fragments of different streams may be interleaved).
+ */
+void reasm_init( struct reasm_table *t, int by_stream )
+{
+        memset( t, 0, sizeof(*t));
+        t->size = REASM_INITIAL_SIZE;
+        t->by_stream = by_stream;
+        t->entries = mem_zalloc( t->size * sizeof(*t->entries));
+}
+
+/**
+ * Release all the memory allocated for the table.
+ *
+ * @param t Pointer to the table.
+ */
+void reasm_free( struct reasm_table *t )
+{
+        uint32_t i;
+
+        if ( t->entries == NULL )
+                return;
+
+        for ( i = 0; i < t->size; i++ ) {
+                if ( t->entries[i].used ) 
+                        partial_store_free( &t->entries[i].store );
+        }
+        mem_free( t->entries );
+        memset( t, 0, sizeof(*t));
+}
+
+/**
+ * Find the partial store for message under reassembly from given 
+ * association and stream. 
+ *
+ * The returned pointer is valid until the next call to reasm_get(),
+ * reasm_done() or reasm_drop_assoc().
+ *
+ * @param t Pointer to the table.
+ * @param assoc_id The association the data was received from.
+ * @param stream The stream the data was received on.
+ * @return Pointer to the partial store, NULL if there is no message
+ * under reassembly for the association and stream.
+ */
+struct partial_store *reasm_lookup( struct reasm_table *t, 
+                sctp_assoc_t assoc_id, uint16_t stream )
+{
+        uint32_t i;
+
+        if ( !t->by_stream )
+                stream = 0;
+
+        i = reasm_find( t, assoc_id, stream );
+        return t->entries[i].used ? &t->entries[i].store : NULL;
+}
+
+/**
+ * Get the partial store for message from given association and stream.
+ *
+ * If there is no message under reassembly for the key, new store is taken
+ * into use. The returned pointer is valid until the next call to
+ * reasm_get(), reasm_done() or reasm_drop_assoc().
+ *
+ * @param t Pointer to the table.
+ * @param assoc_id The association the data was received from.
+ * @param stream The stream the data was received on.
+ * @return Pointer to the partial store for the message.
+ */
+struct partial_store *reasm_get( struct reasm_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream )
+{
+        struct reasm_entry *e;
+        uint32_t i;
+
+        if ( !t->by_stream )
+                stream = 0;
+
+        i = reasm_find( t, assoc_id, stream );
+        if ( t->entries[i].used )
+                return &t->entries[i].store;
+
+        if ( (t->count + 1) * 2 > t->size ) {
+                reasm_grow( t );
+                i = reasm_find( t, assoc_id, stream );
+        }
+        e = &t->entries[i];
+        e->assoc_id = assoc_id;
+        e->stream = stream;
+        e->used = 1;
+        partial_store_init( &e->store );
+
+        t->count++;
+        TRACE("New message from association %d stream %d, %u under reassembly\n",
+                        assoc_id, stream, t->count );
+        return &e->store;
+}
+
+/**
+ * Mark the message from given association and stream complete.
+ *
+ * @param t Pointer to the table.
+ * @param assoc_id The association the message was received from.
+ * @param stream The stream the message was received on.
+ */
+void reasm_done( struct reasm_table *t, sctp_assoc_t assoc_id, 
+                uint16_t stream )
+{
+        uint32_t i;
+
+        if ( !t->by_stream )
+                stream = 0;
+
+        i = reasm_find( t, assoc_id, stream );
+        if ( t->entries[i].used )
+                reasm_remove( t, i );
+}
+
+/**
+ * Discard all the messages under reassembly from the association.
+ *
+ * Should be called once the association is gone so that its incomplete
+ * messages do not stay on the table.
+ *
+ * @param t Pointer to the table.
+ * @param assoc_id The association.
+ */
+void reasm_drop_assoc( struct reasm_table *t, sctp_assoc_t assoc_id )
+{
+        uint32_t i = 0;
+
+        if ( !t->by_stream ) {
+                reasm_done( t, assoc_id, 0 );
+                return;
+        }
+        /* the entries shift back on removal, recheck the same slot */
+        while ( i < t->size && t->count > 0 ) {
+                if ( t->entries[i].used && t->entries[i].assoc_id == assoc_id ) {
+                        reasm_remove( t, i );
+                        continue;
+                }
+                i++;
+        }
+}
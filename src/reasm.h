@@ -0,0 +1,77 @@
+/**
+ * @file reasm.h - Reassembly of partial messages per association and stream.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _REASM_H_
+#define _REASM_H_
+
+/**
+ * Initial number of slots on the reassembly table, must be power of two.
+ */
+#define REASM_INITIAL_SIZE 64
+
+/**
+ * Message under reassembly, one slot on the table.
+ */
+struct reasm_entry {
+        sctp_assoc_t assoc_id; /**< Association the message is from */
+        uint16_t stream; /**< Stream the message is on, 0 if not keyed */
+        uint16_t used; /**< 1 if the slot is in use */
+        struct partial_store store; /**< Data collected so far */
+};
+
+/**
+ * Open addressing (linear probing) hash of the messages under reassembly
+ * on one-to-many socket.
+ *
+ * The messages are keyed by association and, if the fragments of
+ * different streams can be interleaved, by stream. The buffers of the
+ * completed messages are returned to the partial store pool and reused
+ * for the next ones.
+ */
+struct reasm_table {
+        struct reasm_entry *entries; /**< The slots, NULL if not initialized */
+        uint32_t size; /**< Number of slots, power of two */
+        uint32_t count; /**< Number of slots in use */
+        int by_stream; /**< 1 if messages are keyed also by stream */
+};
+
+void reasm_init( struct reasm_table *t, int by_stream );
+void reasm_free( struct reasm_table *t );
+struct partial_store *reasm_lookup( struct reasm_table *t, 
+                sctp_assoc_t assoc_id, uint16_t stream );
+struct partial_store *reasm_get( struct reasm_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream );
+void reasm_done( struct reasm_table *t, sctp_assoc_t assoc_id, 
+                uint16_t stream );
+void reasm_drop_assoc( struct reasm_table *t, sctp_assoc_t assoc_id );
+
+#endif /* _REASM_H_ */
@@ -44,6 +44,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #define DBG_MODULE_NAME DBG_MODULE_CLIENT
 
@@ -51,6 +52,21 @@
 #include "debug.h"
 #include "common.h"
 #include "sctp_auth.h"
+#include "pacing.h"
+#include "histogram.h"
+#include "stats.h"
+#include "payload.h"
+#include "batch.h"
+#include "failover.h"
+#include "streams.h"
+#ifdef HAVE_URING
+#include "uring.h"
+#endif /* HAVE_URING */
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif /* HAVE_EPOLL */
 
 /**
  * Maximum lenght for the file where to read the data.
@@ -61,151 +77,1588 @@
  */
 #define DEFAULT_FILENAME "/dev/urandom"
 
-/**
- * Default value for PPID if seqpkt socket is used.
- */
-#define DEFAULT_PPID 0
-/**
- * Default value for stream ID if seqpkt socket is used.
- */
-#define DEFAULT_STREAM_NO 0
+/**
+ * Default value for PPID if seqpkt socket is used.
+ */
+#define DEFAULT_PPID 0
+/**
+ * Default value for stream ID if seqpkt socket is used.
+ */
+#define DEFAULT_STREAM_NO 0
+
+/**
+ * Number of milliseconds to wait for reply in echo mode.
+ */
+#define ECHO_WAIT_MS 500
+/**
+ * Default size for chunk to send.
+ */
+#define DEFAULT_CHUNK_SIZE 120
+/**
+ * Default number of packets to send.
+ */
+#define DEFAULT_COUNT 5
+/**
+ * Maximum number of events to handle on one epoll_wait() round on the
+ * multi-association mode.
+ */
+#define MULTI_MAX_EVENTS 64
+/**
+ * Messages larger than this are sent on large-message mode.
+ */
+#define MAX_CONTIG_SIZE 65535
+/**
+ * Default segment size on large-message mode.
+ */
+#define DEFAULT_SEGMENT_SIZE 65536
+/**
+ * Maximum number of iovecs for one sendmsg() (UIO_MAXIOV).
+ */
+#define LARGE_IOV_MAX 1024
+/**
+ * Size of the control messages sent with --control.
+ */
+#define CONTROL_MSG_SIZE 64
+/**
+ * Interval for reading the notifications of abandoned messages when
+ * echoes are not read, in milliseconds.
+ */
+#define EVENT_CHECK_MS 10
+/**
+ * Number of messages sent in a row with one send function on --send-bench.
+ */
+#define SEND_BENCH_BLOCK 1024
+
+/**
+ * Number of streams whose partial echoes are tracked.
+ */
+#define ECHO_STREAMS 65536
+
+/**
+ * Main context for the client.
+ */
+struct client_ctx {
+        struct sockaddr_storage host; /**< Remote host address */
+        struct addr_set peers; /**< All addresses of the remote host */
+        uint16_t port;/**< Port number for remote host */
+        uint16_t lport; /**< Port number for local port or 0 */
+        uint32_t chunk_size; /**< Number of bytes to send on each write */
+        uint32_t recvbuf_size; /**< Size of the buffer for received echoes */
+        uint32_t segment; /**< Segment size on large-message mode, or 0 */
+        int eor; /**< 1 if large messages are sent with explicit EOR */
+        struct iovec *iov; /**< Segments of the large message */
+        uint32_t chunk_count;/**< Number of writes to do */
+        char filename[FILENAME_LEN]; /**< File to read data from */
+        uint32_t ppid; /**< PPID to set to the packet. */
+        uint16_t streamno; /**< Stream id to set to the packet. */
+        uint16_t stream; /**< Stream of the message being sent */
+        struct stream_sel sel; /**< Streams to spread the messages on */
+        int stamp; /**< 1 if the messages carry the latency header */
+        uint16_t associations; /**< Number of concurrent associations */
+        uint64_t rate; /**< Target message rate (msgs/s) or 0 */
+        uint64_t bandwidth; /**< Target payload bandwidth (bits/s) or 0 */
+        uint32_t burst; /**< Maximum number of messages to send back-to-back */
+        int paced; /**< 1 if the sends are paced */
+        uint32_t window; /**< Maximum number of echoes in flight */
+        uint32_t inflight; /**< Number of echoes in flight */
+        uint32_t echo_timeouts; /**< Number of echoes not received in time */
+        uint8_t echo_partial[ECHO_STREAMS / 8]; /**< Bit set for each stream in middle of a partially received echo */
+        struct pacer pacer; /**< Pacer for the sends */
+        int latency; /**< 1 if round-trip latency is measured */
+        uint32_t lat_seq; /**< Sequence number for the next message */
+        uint64_t lat_unmatched; /**< Number of echoes not matching a send */
+        uint64_t lat_start_ns; /**< Time the measurement started */
+        uint64_t lat_report_ns; /**< Time of the last report */
+        struct histogram *lat_total; /**< RTTs for the whole run */
+        struct histogram *lat_interval; /**< RTTs for the current interval */
+        struct tput_stats stats; /**< Statistics for the sent messages */
+        struct payload payload; /**< Preloaded messages to send */
+        struct mmsg_batch batch; /**< Messages queued for sendmmsg() */
+        uint64_t failover_ns; /**< Stall threshold on failover mode, 0 if not used */
+        uint64_t ctrl_rate; /**< Rate of the control messages, 0 if not sent */
+        uint64_t ctrl_sent; /**< Number of control messages sent */
+        struct pacer ctrl_pacer; /**< Pacer for the control messages */
+        struct histogram *ctrl_lat; /**< RTTs of the control messages in echo mode */
+        int compare; /**< 1 if the run is repeated without and with I-DATA */
+        int send_bench; /**< 1 if the cost of the send calls is measured */
+        uint8_t ctrl_msg[CONTROL_MSG_SIZE]; /**< The control message */
+        struct failover failover; /**< Failover measurement */
+        uint32_t msg_seq; /**< Context for the next message sent */
+        int send_acct; /**< 1 if the abandoned messages are accounted */
+        int event_partial; /**< 1 if in middle of a partially read notification */
+        uint64_t abandoned_unsent; /**< Messages abandoned before sent */
+        uint64_t abandoned_sent; /**< Messages abandoned after sent */
+        uint32_t abandoned_last; /**< Context of the last abandoned message */
+        uint64_t event_check_ns; /**< Time the notifications were last read */
+        struct common_context common; /**< Context common for client and server*/
+};
+
+/**
+ * Subscribe to the SCTP I/O events.
+ *
+ * We need to subscribe to I/O events to be able to show them from received
+ * data.
+ *
+ * @param sock The socket whose events to subscribe.
+ * @param send_failures 1 if the notifications about the messages which 
+ * could not be delivered are subscribed too.
+ */
+static void subscribe_io_events( int sock, int send_failures )
+{
+        struct sctp_event_subscribe event;
+
+        memset(&event, 0, sizeof(event));
+        event.sctp_data_io_event = 1;
+        event.sctp_send_failure_event = send_failures;
+
+        if (setsockopt(sock, IPPROTO_SCTP, SCTP_EVENTS,
+                                &event, sizeof(event)) != 0 ) {
+                WARN("Unable to register for SCTP IO events: %s \n",
+                                strerror(errno));
+                /* not a fatal error, we just get the I/O info wrong */
+        }
+}
+
+/**
+ * Start the latency measurement.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void latency_start( struct client_ctx *ctx )
+{
+        ctx->lat_total = hist_create();
+        ctx->lat_interval = hist_create();
+        ctx->lat_start_ns = time_now_ns();
+        ctx->lat_report_ns = ctx->lat_start_ns;
+}
+
+/**
+ * Place the latency header to the start of message about to be sent.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk The message, should have room for the header.
+ */
+static void latency_stamp( struct client_ctx *ctx, uint8_t *chunk )
+{
+        struct latency_hdr hdr;
+
+        hdr.magic = LATENCY_MAGIC;
+        hdr.seq = ctx->lat_seq++;
+        hdr.send_ns = time_now_ns();
+        memcpy( chunk, &hdr, sizeof(hdr));
+}
+
+/**
+ * Match the received echo to the message sent.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param buf The first part of the received echo.
+ * @param len Number of bytes received.
+ * @param rtt Pointer where the round-trip time is set.
+ * @return 0 if the echo matches a message sent, -1 if not.
+ */
+static int latency_match( struct client_ctx *ctx, uint8_t *buf, int len,
+                uint64_t *rtt )
+{
+        struct latency_hdr hdr;
+        uint64_t now = time_now_ns();
+
+        if ( len < (int)sizeof(hdr)) {
+                ctx->lat_unmatched++;
+                return -1;
+        }
+        memcpy( &hdr, buf, sizeof(hdr));
+        if ( hdr.magic != LATENCY_MAGIC || hdr.seq >= ctx->lat_seq ||
+                        hdr.send_ns > now ) {
+                TRACE("Echo does not match any message sent\n");
+                ctx->lat_unmatched++;
+                return -1;
+        }
+        *rtt = now - hdr.send_ns;
+        return 0;
+}
+
+/**
+ * Match the received echo to the message sent and record the round-trip
+ * time.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param buf The received data.
+ * @param len Number of bytes received.
+ * @param first 1 if this is the first part of the echo.
+ */
+static void latency_record( struct client_ctx *ctx, uint8_t *buf, int len,
+                int first )
+{
+        uint64_t rtt;
+
+        if ( !first )
+                return; /* rest of the echo, header was on first part */
+
+        if ( latency_match( ctx, buf, len, &rtt ) < 0 )
+                return;
+        hist_record( ctx->lat_total, rtt );
+        hist_record( ctx->lat_interval, rtt );
+}
+
+/**
+ * Print the latency statistics for the interval if the interval has
+ * elapsed.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void latency_tick( struct client_ctx *ctx )
+{
+        uint64_t now;
+        char label[40];
+
+        if ( !ctx->latency || ctx->common.interval_ns == 0 )
+                return;
+
+        now = time_now_ns();
+        if ( now - ctx->lat_report_ns < ctx->common.interval_ns )
+                return;
+
+        snprintf( label, sizeof(label), "[%7.2f-%7.2f s] RTT", 
+                        (double)(ctx->lat_report_ns - ctx->lat_start_ns) / NSEC_PER_SEC,
+                        (double)(now - ctx->lat_start_ns) / NSEC_PER_SEC );
+        hist_print( stdout, label, ctx->lat_interval );
+        hist_reset( ctx->lat_interval );
+        ctx->lat_report_ns = now;
+}
+
+/**
+ * Print the summary of the latency measurement and release the
+ * histograms.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void latency_finish( struct client_ctx *ctx )
+{
+        if ( ctx->lat_total == NULL )
+                return;
+
+        hist_print( stdout, "RTT summary", ctx->lat_total );
+        printf("%" PRIu32 " sent, %" PRIu64 " echoes matched, %" PRIu64 
+                        " unmatched\n", ctx->lat_seq, ctx->lat_total->total,
+                        ctx->lat_unmatched );
+        hist_delete( ctx->lat_total );
+        hist_delete( ctx->lat_interval );
+        ctx->lat_total = NULL;
+        ctx->lat_interval = NULL;
+}
+
+/**
+ * Account the received echo and print information about it.
+ *
+ * When the echo is completely received, the number of echoes in flight is
+ * decremented. The partial echoes are tracked per stream, as with I-DATA
+ * the parts of the messages on different streams may be interleaved. 
+ * The round-trip times of the control messages are recorded separately.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk The received data.
+ * @param recv_len Number of bytes received.
+ * @param recv_flags Flags of the received message.
+ * @param peer Sender of the message.
+ * @param info SCTP information of the message.
+ */
+static void handle_echo( struct client_ctx *ctx, uint8_t *chunk, int recv_len,
+                int recv_flags, struct sockaddr_storage *peer,
+                struct sctp_sndrcvinfo *info )
+{
+        uint16_t stream = info->sinfo_stream;
+        uint8_t bit = 1 << (stream & 7);
+        uint64_t rtt;
+        int first;
+
+        if (is_flag(ctx->common.options, VERBOSE_FLAG) &&
+                        !is_flag(ctx->common.options, REPORT_FLAG))
+                print_input(peer, recv_len, recv_flags, info);
+
+        first = !(ctx->echo_partial[stream >> 3] & bit);
+        if ( recv_flags & MSG_EOR ) {
+                ctx->echo_partial[stream >> 3] &= ~bit;
+                if ( ctx->inflight > 0 )
+                        ctx->inflight--;
+        } else {
+                ctx->echo_partial[stream >> 3] |= bit;
+        }
+
+        if ( ctx->ctrl_lat != NULL && stream == 0 ) {
+                if ( first && latency_match( ctx, chunk, recv_len, &rtt ) == 0 )
+                        hist_record( ctx->ctrl_lat, rtt );
+        } else if ( ctx->latency ) 
+                latency_record( ctx, chunk, recv_len, first );
+        else if ( !is_flag(ctx->common.options, REPORT_FLAG))
+                printf("Received %d bytes of possible echo\n", recv_len);
+        if (is_flag(ctx->common.options, XDUMP_FLAG))
+                xdump_data(stdout,chunk, recv_len, "Received data");
+}
+
+/**
+ * Account the message which could not be delivered.
+ *
+ * The message is identified by the context given when it was sent. The
+ * notification is sent for each fragment of the message, the message is
+ * counted only once. In echo mode the message is no longer waited for.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param buf The received notification.
+ * @param len Length of the notification.
+ * @param flags Flags of the received notification.
+ */
+static void handle_notification( struct client_ctx *ctx, uint8_t *buf, 
+                int len, int flags )
+{
+        union sctp_notification *sn = (union sctp_notification *)buf;
+        struct sctp_send_failed *ssf;
+        int partial;
+        uint32_t context;
+
+        /* only the start of the notification is of interest, the
+         * rest is the data of the failed message */
+        partial = ctx->event_partial;
+        ctx->event_partial = !(flags & MSG_EOR);
+        if ( partial || len < (int)sizeof(*ssf) || 
+                        sn->sn_header.sn_type != SCTP_SEND_FAILED )
+                return;
+
+        ssf = &sn->sn_send_failed;
+        context = ssf->ssf_info.sinfo_context;
+        if ( ctx->abandoned_unsent + ctx->abandoned_sent > 0 &&
+                        context == ctx->abandoned_last )
+                return;
+
+        ctx->abandoned_last = context;
+        if ( ssf->ssf_flags == SCTP_DATA_UNSENT )
+                ctx->abandoned_unsent++;
+        else
+                ctx->abandoned_sent++;
+        if ( is_flag( ctx->common.options, ECHO_FLAG ) && ctx->inflight > 0 )
+                ctx->inflight--;
+
+        if ( is_flag( ctx->common.options, VERBOSE_FLAG ) &&
+                        !is_flag( ctx->common.options, REPORT_FLAG ))
+                printf("Message %" PRIu32 " abandoned (%s, error %" PRIu32 ")\n",
+                                context, ssf->ssf_flags == SCTP_DATA_UNSENT ?
+                                "unsent" : "sent", ssf->ssf_error );
+}
+
+/**
+ * Wait for echo from the server and print information about it.
+ *
+ * The notifications arriving meanwhile are handled and the echo is waited
+ * for the rest of the time.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk Buffer for the received data.
+ * @param timeout_ms Number of milliseconds to wait for the echo.
+ * @param addrlen Length of the remote address.
+ * @return Number of bytes received, 0 on timeout, -1 on error.
+ */
+static int recv_echo( struct client_ctx *ctx, uint8_t *chunk, 
+                time_t timeout_ms, socklen_t addrlen )
+{
+        struct sockaddr_storage peer;
+        struct sctp_sndrcvinfo info;
+        socklen_t peer_len;
+        int recv_len, recv_flags;
+        uint64_t until = 0, now;
+
+        if ( ctx->send_acct && timeout_ms > 0 )
+                until = time_now_ns() + timeout_ms * 1000000ULL;
+        while ( 1 ) {
+                memset( &peer, 0, sizeof(peer));
+                memset( &info, 0, sizeof(info));
+                peer_len = addrlen;
+                recv_flags = 0;
+                if ( is_flag( ctx->common.options, BUSY_POLL_FLAG ))
+                        recv_len = recv_spin( ctx->common.sock, 
+                                        timeout_ms, chunk, ctx->recvbuf_size, 
+                                        (struct sockaddr *)&peer, &peer_len,
+                                        &info,&recv_flags);
+                else 
+                        recv_len = recv_wait( ctx->common.sock, 
+                                        timeout_ms, chunk, ctx->recvbuf_size, 
+                                        (struct sockaddr *)&peer, &peer_len,
+                                        &info,&recv_flags);
+
+                if ( recv_len <= 0 || !(recv_flags & MSG_NOTIFICATION))
+                        break;
+
+                handle_notification( ctx, chunk, recv_len, recv_flags );
+                now = time_now_ns();
+                timeout_ms = until > now ? (until - now) / 1000000ULL : 0;
+        }
+
+        if ( recv_len < 0 ) {
+                WARN("Error while receiving data\n");
+                print_error("Unable to read received data", errno);
+                return -1;
+        } else if ( recv_len > 0 ) {
+                handle_echo( ctx, chunk, recv_len, recv_flags, &peer, &info );
+        }
+        return recv_len;
+}
+
+/**
+ * Read the notifications about abandoned messages when the echoes are not
+ * read. Anything else received is discarded.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk Buffer for the received data.
+ * @param timeout_ms Number of milliseconds to wait for each notification.
+ * @return -1 on error, 0 on success.
+ */
+static int read_notifications( struct client_ctx *ctx, uint8_t *chunk, 
+                time_t timeout_ms )
+{
+        struct sctp_sndrcvinfo info;
+        int recv_len, recv_flags;
+
+        do {
+                recv_flags = 0;
+                recv_len = recv_wait( ctx->common.sock, timeout_ms, chunk,
+                                ctx->recvbuf_size, NULL, NULL, &info, 
+                                &recv_flags );
+                if ( recv_len == -2 )
+                        break; /* the association is closed */
+                if ( recv_len < 0 ) {
+                        print_error("Unable to read notifications", errno);
+                        return -1;
+                }
+                if ( recv_len > 0 && (recv_flags & MSG_NOTIFICATION))
+                        handle_notification( ctx, chunk, recv_len, recv_flags );
+        } while ( recv_len > 0 );
+
+        ctx->event_check_ns = time_now_ns();
+        return 0;
+}
+
+/**
+ * Read the echoes arriving before given time, or until no echoes are in
+ * flight. 
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk Buffer for the received data.
+ * @param until_ns Time until to read the echoes.
+ * @param addrlen Length of the remote address.
+ * @return Number of echoes received, -1 on error.
+ */
+static int drain_echoes( struct client_ctx *ctx, uint8_t *chunk,
+                uint64_t until_ns, socklen_t addrlen )
+{
+        uint64_t now;
+        int ret, cnt = 0;
+
+        while ( ctx->inflight > 0 && 
+                (now = time_now_ns()) + 1000000ULL <= until_ns ) {
+                ret = recv_echo( ctx, chunk, (until_ns - now) / 1000000ULL,
+                                addrlen );
+                if ( ret < 0 )
+                        return -1;
+                else if ( ret == 0 ) 
+                        break;
+
+                latency_tick( ctx );
+                cnt++;
+        }
+        return cnt;
+}
+
+/**
+ * Read the echoes which have arrived. 
+ *
+ * If the window of echoes in flight is full, wait (up to ECHO_WAIT_MS) for
+ * an echo to arrive, if it does not arrive in time it is counted as lost.
+ * The echoes which have already arrived are then read without waiting.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk Buffer for the received data.
+ * @param addrlen Length of the remote address.
+ * @return -1 on error, 0 on success.
+ */
+static int read_echoes( struct client_ctx *ctx, uint8_t *chunk,
+                socklen_t addrlen )
+{
+        int ret, full;
+
+        while ( ctx->inflight > 0 ) {
+                full = ctx->inflight >= ctx->window;
+                ret = recv_echo( ctx, chunk, full ? ECHO_WAIT_MS : 0, addrlen );
+                if ( ret < 0 ) {
+                        return -1;
+                } else if ( ret == 0 ) {
+                        if ( !full )
+                                break;
+
+                        printf("Timed out while waiting for echo\n");
+                        ctx->echo_timeouts++;
+                        ctx->inflight--;
+                }
+        }
+        return 0;
+}
+
+/**
+ * Wait until the pacer allows next message to be sent. 
+ *
+ * In echo mode the echoes arriving meanwhile are read, the sending is
+ * delayed only if the window of echoes in flight is full.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param chunk Buffer for the received data.
+ * @param addrlen Length of the remote address.
+ * @return -1 on error, 0 when the next message can be sent.
+ */
+static int wait_send_slot( struct client_ctx *ctx, uint8_t *chunk,
+                socklen_t addrlen )
+{
+        uint64_t due;
+
+        if ( is_flag( ctx->common.options, ECHO_FLAG )) {
+                if ( read_echoes( ctx, chunk, addrlen ) < 0 )
+                        return -1;
+                due = pacer_due( &ctx->pacer, time_now_ns());
+                if ( drain_echoes( ctx, chunk, due, addrlen ) < 0 ) 
+                        return -1;
+        }
+
+        while ( pacer_wait( &ctx->pacer ) < 0 ) {
+                if ( errno != EINTR )
+                        return -1;
+        }
+        return 0;
+}
+
+/**
+ * Get the destination address to use when sending.
+ *
+ * @param ctx Pointer to the main client context.
+ * @return The server address for SOCK_SEQPACKET socket, NULL for the
+ * connected sockets.
+ */
+static struct sockaddr *send_dst( struct client_ctx *ctx )
+{
+        if ( is_flag( ctx->common.options, SEQ_FLAG ))
+                return (struct sockaddr *)&ctx->host;
+
+        return NULL;
+}
+
+/**
+ * Connect to the server, unless SOCK_SEQPACKET socket is used.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param addrlen Pointer where the length of the remote address is set.
+ * @return -1 on error, 0 on success.
+ */
+static int connect_host( struct client_ctx *ctx, socklen_t *addrlen )
+{
+        if ( ctx->host.ss_family == AF_INET )
+                *addrlen = sizeof( struct sockaddr_in);
+        else
+                *addrlen = sizeof( struct sockaddr_in6);
+
+        if ( ctx->peers.count > 1 ) {
+                /* with SOCK_SEQPACKET the association is set up
+                 * here too, to have all peer addresses on the INIT */
+                if ( common_connectx( ctx->common.sock, &ctx->peers, 
+                                        ctx->port ) < 0 ) {
+                        print_error("Unable to connect to the peer addresses", errno);
+                        return -1;
+                }
+        } else if ( ! is_flag( ctx->common.options, SEQ_FLAG ) ) {
+                if ( connect( ctx->common.sock,
+                              (struct sockaddr *)&(ctx->host), *addrlen ) < 0 ) {
+                        print_error("Unable to connect()", errno);
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+/**
+ * Send the control messages which are due.
+ *
+ * The control messages are small stamped messages sent on stream 0 at
+ * fixed rate alongside the bulk messages, the server reports their
+ * delivery latency per stream. In echo mode their round-trip time is
+ * measured.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param addrlen Length of the remote address.
+ * @return -1 on error, 0 on success.
+ */
+static int send_control( struct client_ctx *ctx, socklen_t addrlen )
+{
+        uint64_t now = time_now_ns();
+
+        while ( pacer_due( &ctx->ctrl_pacer, now ) <= now ) {
+                pacer_advance( &ctx->ctrl_pacer );
+                latency_stamp( ctx, ctx->ctrl_msg );
+                if ( sendit( ctx->common.sock, ctx->ppid, 0, ctx->msg_seq++,
+                                        send_dst( ctx ), addrlen, ctx->ctrl_msg, 
+                                        CONTROL_MSG_SIZE ) < 0 )
+                        return -1;
+                ctx->ctrl_sent++;
+                if ( is_flag( ctx->common.options, ECHO_FLAG ))
+                        ctx->inflight++;
+        }
+        return 0;
+}
+
+/**
+ * Wait for a key press if the connection should be kept.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void keep_connection( struct client_ctx *ctx )
+{
+        char c;
+
+        if ( is_flag( ctx->common.options, KEEP_FLAG ) ) {
+                printf("Press any key to terminate the client ...\n");
+                if ( read( 0, &c, 1 ) < 0 ) {
+                        WARN("read() failed : %s \n", strerror(errno));
+                }
+        }
+}
+
+/**
+ * Print whether I-DATA was negotiated for the association. Both endpoints
+ * have to enable it, otherwise DATA chunks are used. Reported when
+ * --interleave is given, and on both runs of --interleave-compare.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void report_interleave( struct client_ctx *ctx )
+{
+#ifdef SCTP_INTERLEAVING_SUPPORTED
+        struct sctp_assoc_value av;
+        socklen_t len;
+
+        memset( &av, 0, sizeof(av));
+        av.assoc_id = ctx->sel.assoc_id;
+        len = sizeof(av);
+        if ( getsockopt( ctx->common.sock, IPPROTO_SCTP, 
+                                SCTP_INTERLEAVING_SUPPORTED, &av, &len ) < 0 )
+                return;
+
+        if ( av.assoc_value )
+                printf("I-DATA interleaving negotiated\n");
+        else if ( ctx->common.tuning.set & TUNE_INTERLEAVE )
+                printf("I-DATA interleaving not negotiated, the peer should use --interleave\n");
+        else
+                printf("I-DATA interleaving not negotiated, DATA chunks used\n");
+#else
+        (void)ctx;
+#endif /* SCTP_INTERLEAVING_SUPPORTED */
+}
+
+/**
+ * Switch to explicit EOR if the large message does not fit on the send
+ * buffer.
+ *
+ * Without explicit EOR the whole message is passed to one sendmsg(), and
+ * the kernel does not queue a message larger than the send buffer. With
+ * explicit EOR the segments are queued one by one.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void check_sndbuf( struct client_ctx *ctx )
+{
+        int val;
+        socklen_t len = sizeof(val);
+
+        if ( getsockopt( ctx->common.sock, SOL_SOCKET, SO_SNDBUF, &val, &len ) < 0 ||
+                        val <= 0 || ctx->chunk_size <= (uint32_t)val )
+                return;
+
+        fprintf(stderr, "Warning: chunk of %" PRIu32 " bytes does not fit on the "
+                        "%d byte send buffer, sending it with --eor (or raise --sndbuf)\n",
+                        ctx->chunk_size, val);
+        ctx->eor = 1;
+}
+
+/**
+ * Send one large message.
+ *
+ * The message is gathered from segments of the payload pool without
+ * copying. Without explicit EOR the whole message is sent with one
+ * sendmsg(), with explicit EOR each segment is sent separately and the
+ * last one completes the message.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param addrlen Length of the remote address.
+ * @return Number of bytes sent, -1 on error.
+ */
+static ssize_t send_large( struct client_ctx *ctx, socklen_t addrlen )
+{
+        uint32_t left = ctx->chunk_size, len;
+        ssize_t ret, total = 0;
+        int n, per_call;
+
+        per_call = ctx->eor ? 1 : LARGE_IOV_MAX;
+        while ( left > 0 ) {
+                for ( n = 0; n < per_call && left > 0; n++ ) {
+                        len = left < ctx->segment ? left : ctx->segment;
+                        ctx->iov[n].iov_base = payload_next( &ctx->payload );
+                        ctx->iov[n].iov_len = len;
+                        left -= len;
+                }
+                if ( total == 0 && ctx->stamp )
+                        latency_stamp( ctx, ctx->iov[0].iov_base );
+
+                ret = sendit_iov( ctx->common.sock, ctx->ppid, ctx->stream,
+                                ctx->msg_seq, send_dst( ctx ), addrlen, 
+                                ctx->iov, n, 
+                                (ctx->eor && left == 0) ? MSG_EOR : 0 );
+                if ( ret < 0 )
+                        return -1;
+                total += ret;
+        }
+        ctx->msg_seq++;
+        TRACE("Sent large message of %zd bytes\n", total );
+        return total;
+}
+
+/**
+ * Queue message to the batch and send the batch if it is full or the
+ * message should not be delayed.
+ *
+ * The batch is sent when the last message is queued, when the pacer
+ * has no slots to catch up or when the queued messages would fill the
+ * window of echoes in flight.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param msg The message to send.
+ * @param addrlen Length of the remote address.
+ * @param last 1 if this is the last message to send.
+ * @return Number of messages sent, 0 if the message was queued, -1 on
+ * error.
+ */
+static int send_batched( struct client_ctx *ctx, uint8_t *msg, 
+                socklen_t addrlen, int last )
+{
+        uint64_t now;
+
+        if ( batch_add( &ctx->batch, (struct sockaddr *)&ctx->host, addrlen,
+                                msg, ctx->chunk_size, ctx->ppid, 
+                                ctx->stream, ctx->msg_seq++ ) < 0 ) {
+                errno = ENOBUFS;
+                return -1;
+        }
+        if ( last || BATCH_FULL( &ctx->batch ))
+                return batch_flush( ctx->common.sock, &ctx->batch );
+
+        if ( is_flag( ctx->common.options, ECHO_FLAG ) &&
+                        ctx->inflight + ctx->batch.count >= ctx->window )
+                return batch_flush( ctx->common.sock, &ctx->batch );
+
+        if ( ctx->paced ) {
+                now = time_now_ns();
+                if ( pacer_due( &ctx->pacer, now ) > now )
+                        return batch_flush( ctx->common.sock, &ctx->batch );
+        }
+        return 0;
+}
+
+/**
+ * Do the client operation. 
+ *
+ * Send the required data and, if in echo mode, wait for reply packets. Up
+ * to ctx->window echoes can be in flight. If rate or bandwidth is set, the
+ * messages are sent on fixed schedule and echoes are read between the
+ * sends.
+ *
+ * @param ctx Pointer to the main client context.
+ * @return -1 on error, 0 on success.
+ */
+static int do_client( struct client_ctx *ctx )
+{
+        socklen_t addrlen;
+        int ret, sent, j;
+        uint32_t i;
+        uint64_t until, due_ns = 0;
+        uint8_t *chunk, *msg;
+
+        if ( connect_host( ctx, &addrlen ) < 0 )
+                return -1;
+
+        TRACE("Reading data from %s \n", ctx->filename );
+        if ( payload_init( &ctx->payload, ctx->filename, 
+                        ctx->segment > 0 ? ctx->segment : ctx->chunk_size ) < 0 ) {
+                print_error("Unable to load data to send", errno);
+                return -1;
+        }
+        if ( ctx->segment > 0 && !ctx->eor )
+                check_sndbuf( ctx );
+        if ( ctx->eor ) {
+                ret = 1;
+                if ( setsockopt( ctx->common.sock, IPPROTO_SCTP, SCTP_EXPLICIT_EOR,
+                                        &ret, sizeof(ret)) < 0 ) {
+                        print_error("Unable to enable explicit EOR", errno);
+                        payload_free( &ctx->payload );
+                        return -1;
+                }
+        }
+
+        chunk = mem_alloc( ctx->recvbuf_size );
+        if ( ctx->segment > 0 ) 
+                ctx->iov = mem_alloc( LARGE_IOV_MAX * sizeof(*ctx->iov));
+        if ( ctx->common.batch > 0 ) {
+                /* stamped messages are copied, the payload slot may be 
+                 * reused before the batch is sent */
+                batch_init( &ctx->batch, ctx->common.batch, 
+                                ctx->stamp ? ctx->chunk_size : 0 );
+        }
+
+        if ( ctx->latency )
+                latency_start( ctx );
+        stats_init( &ctx->stats, ctx->common.interval_ns );
+        if ( ctx->sel.requested > 0 )
+                stream_sel_resolve( &ctx->sel, ctx->common.sock );
+        if ( ctx->failover_ns > 0 && 
+                        failover_start( &ctx->failover, ctx->common.sock, 
+                                ctx->failover_ns ) < 0 )
+                ctx->failover_ns = 0;
+        common_prepare_io( &ctx->common, 0 );
+        if ( ctx->paced ) 
+                pacer_start( &ctx->pacer, time_now_ns());
+        if ( ctx->ctrl_rate > 0 )
+                pacer_start( &ctx->ctrl_pacer, time_now_ns());
+
+        for( i = 0; i < ctx->chunk_count; i++ ) {
+
+                if ( ctx->paced && wait_send_slot( ctx, chunk, addrlen ) < 0 ) {
+                        print_error("Unable to wait for send slot", errno);
+                        break;
+                }
+                if ( ctx->paced ) {
+                        due_ns = pacer_due( &ctx->pacer, time_now_ns());
+                        pacer_advance( &ctx->pacer );
+                }
+                if ( ctx->sel.requested > 0 ) {
+                        /* on one-to-many socket the association is set
+                         * up by the first message */
+                        if ( ctx->sel.count == 0 )
+                                stream_sel_resolve( &ctx->sel, ctx->common.sock );
+                        ctx->stream = stream_sel_next( &ctx->sel );
+                }
+                if ( ctx->ctrl_rate > 0 && send_control( ctx, addrlen ) < 0 ) {
+                        print_error("Unable to send control message", errno);
+                        break;
+                }
+                if ( !ctx->latency && !is_flag(ctx->common.options, REPORT_FLAG))
+                        print_progress( i + 1, ctx->chunk_count );
+
+                DBG("Sending %d bytes \n", ctx->chunk_size );
+                if ( ctx->segment > 0 ) {
+                        ret = send_large( ctx, addrlen ) < 0 ? -1 : 1;
+                        sent = 1;
+                } else {
+                        msg = payload_next( &ctx->payload );
+                        if (is_flag(ctx->common.options, XDUMP_FLAG ))
+                                xdump_data( stdout, msg, ctx->chunk_size, "Data to send");
+                        if ( ctx->stamp )
+                                latency_stamp( ctx, msg );
+
+                        if ( ctx->common.batch > 0 ) {
+                                ret = send_batched( ctx, msg, addrlen, 
+                                                i + 1 == ctx->chunk_count );
+                                sent = ret;
+                        } else {
+                                ret = sendit( ctx->common.sock, ctx->ppid, 
+                                                ctx->stream, ctx->msg_seq++,
+                                                send_dst( ctx ), addrlen, msg, 
+                                                ctx->chunk_size );
+                                sent = 1;
+                        }
+                }
+
+                if ( ret < 0 ) {
+                        print_error("Unable to send data", errno);
+                        break;
+                }
+                if ( sent == 0 )
+                        continue; /* queued to the batch */
+
+                stats_add( &ctx->stats, sent, (uint64_t)sent * ctx->chunk_size );
+                if ( ctx->failover_ns > 0 )
+                        failover_tick( &ctx->failover, due_ns );
+                if (is_flag(ctx->common.options, VERBOSE_FLAG) &&
+                                !is_flag(ctx->common.options, REPORT_FLAG)) {
+                        for ( j = 0; j < sent; j++ )
+                                print_output_verbose(&ctx->host, ctx->chunk_size,
+                                                ctx->ppid, ctx->stream);
+                }
+
+                if ( is_flag( ctx->common.options, ECHO_FLAG )) {
+                        ctx->inflight += sent;
+                        if ( !ctx->paced && read_echoes( ctx, chunk, addrlen ) < 0 )
+                                break;
+                } else if ( ctx->send_acct && time_now_ns() >= 
+                                ctx->event_check_ns + EVENT_CHECK_MS * 1000000ULL ) {
+                        if ( read_notifications( ctx, chunk, 0 ) < 0 )
+                                break;
+                }
+                latency_tick( ctx );
+                stats_tick( &ctx->stats, "" );
+        }
+        if ( is_flag( ctx->common.options, ECHO_FLAG )) {
+                /* wait for the rest of the echoes */
+                until = time_now_ns() + ECHO_WAIT_MS * 1000000ULL;
+                while ( ctx->inflight > 0 && time_now_ns() < until ) {
+                        if ( drain_echoes( ctx, chunk, until, addrlen ) <= 0 )
+                                break;
+                }
+                if ( ctx->inflight > 0 ) {
+                        printf("Timed out while waiting for %" PRIu32 " echoes\n",
+                                        ctx->inflight );
+                        ctx->echo_timeouts += ctx->inflight;
+                        ctx->inflight = 0;
+                }
+        } else if ( ctx->send_acct ) {
+                /* the messages still queued may be abandoned later */
+                read_notifications( ctx, chunk, ECHO_WAIT_MS );
+        }
+        payload_free( &ctx->payload );
+        batch_free( &ctx->batch );
+        if ( ctx->iov != NULL ) 
+                mem_free( ctx->iov );
+        ctx->iov = NULL;
+        if ( ctx->failover_ns > 0 )
+                failover_final( &ctx->failover );
+        if ( is_flag( ctx->common.options, REPORT_FLAG ))
+                stats_final( &ctx->stats, "" );
+        if ( ctx->ctrl_rate > 0 )
+                printf("Sent %" PRIu64 " control messages on stream 0\n", 
+                                ctx->ctrl_sent );
+        if ( ctx->ctrl_lat != NULL )
+                hist_print( stdout, "Control RTT", ctx->ctrl_lat );
+        if ( (ctx->common.tuning.set & TUNE_INTERLEAVE) || ctx->compare )
+                report_interleave( ctx );
+        if ( ctx->send_acct )
+                printf("%" PRIu64 " of %" PRIu32 " messages abandoned (%" PRIu64 
+                                " unsent, %" PRIu64 " sent)\n", 
+                                ctx->abandoned_unsent + ctx->abandoned_sent,
+                                ctx->msg_seq, ctx->abandoned_unsent, 
+                                ctx->abandoned_sent );
+        latency_finish( ctx );
+        keep_connection( ctx );
+        mem_free( chunk );
+        close( ctx->common.sock );
+        ctx->common.sock = -1;
+
+        return 0;
+}
+
+#ifdef HAVE_URING
+/**
+ * Do the client operation with the io_uring engine.
+ *
+ * The messages are queued to the engine as long as the window of echoes
+ * and the pacer allow, and all queued messages are submitted together
+ * with the wait for the next completion. Echoes are received with
+ * multishot receive.
+ *
+ * @param ctx Pointer to the main client context.
+ * @return -1 on error, 0 on success.
+ */
+static int do_client_uring( struct client_ctx *ctx )
+{
+        struct uring_engine *eng;
+        struct uring_event ev;
+        socklen_t addrlen;
+        uint64_t now, due, timeout_ns, active_ns;
+        uint32_t sent = 0;
+        uint8_t *msg;
+        int n, ret = 0, echo;
+
+        if ( connect_host( ctx, &addrlen ) < 0 )
+                return -1;
+
+        TRACE("Reading data from %s \n", ctx->filename );
+        if ( payload_init( &ctx->payload, ctx->filename, ctx->chunk_size ) < 0 ) {
+                print_error("Unable to load data to send", errno);
+                return -1;
+        }
+        eng = uring_create( URING_DEFAULT_DEPTH, 
+                        ctx->chunk_size > ctx->recvbuf_size ? 
+                        ctx->chunk_size : ctx->recvbuf_size );
+        if ( eng == NULL ) {
+                print_error("Unable to create io_uring", errno);
+                payload_free( &ctx->payload );
+                return -1;
+        }
+        echo = is_flag( ctx->common.options, ECHO_FLAG );
+        if ( echo && uring_recv_start( eng, ctx->common.sock ) < 0 ) {
+                print_error("Unable to start receiving", errno);
+                ret = -1;
+                goto out;
+        }
+
+        if ( ctx->latency )
+                latency_start( ctx );
+        stats_init( &ctx->stats, ctx->common.interval_ns );
+        common_prepare_io( &ctx->common, 0 );
+        if ( ctx->paced ) 
+                pacer_start( &ctx->pacer, time_now_ns());
+
+        active_ns = time_now_ns();
+        while ( sent < ctx->chunk_count || uring_sends_pending( eng ) > 0 ||
+                        (echo && ctx->inflight > 0)) {
+                now = time_now_ns();
+                timeout_ns = ECHO_WAIT_MS * 1000000ULL;
+                while ( sent < ctx->chunk_count && 
+                                (!echo || ctx->inflight < ctx->window )) {
+                        if ( ctx->paced ) {
+                                due = pacer_due( &ctx->pacer, now );
+                                if ( due > now ) {
+                                        timeout_ns = due - now;
+                                        break;
+                                }
+                        }
+                        msg = payload_next( &ctx->payload );
+                        if ( ctx->stamp )
+                                latency_stamp( ctx, msg );
+                        if ( uring_send( eng, ctx->common.sock, 
+                                         send_dst( ctx ), addrlen,
+                                         msg, ctx->chunk_size, ctx->ppid, 
+                                         ctx->streamno, ctx->msg_seq++ ) < 0 ) 
+                                break; /* all send slots in use */
+
+                        if ( ctx->paced )
+                                pacer_advance( &ctx->pacer );
+                        if ( !ctx->latency && !is_flag(ctx->common.options, REPORT_FLAG))
+                                print_progress( sent + 1, ctx->chunk_count );
+                        sent++;
+                        if ( echo )
+                                ctx->inflight++;
+                        active_ns = now;
+                }
+
+                n = uring_next( eng, &ev, timeout_ns );
+                if ( n < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+
+                        print_error("Unable to wait for completions", errno);
+                        ret = -1;
+                        break;
+                } else if ( n == 0 ) {
+                        if ( echo && ctx->inflight > 0 && 
+                             time_now_ns() - active_ns > ECHO_WAIT_MS * 1000000ULL ) {
+                                printf("Timed out while waiting for %" PRIu32 " echoes\n",
+                                                ctx->inflight );
+                                ctx->echo_timeouts += ctx->inflight;
+                                ctx->inflight = 0;
+                                if ( sent == ctx->chunk_count )
+                                        break;
+                        }
+                } else if ( ev.type == URING_EV_SEND ) {
+                        if ( ev.res < 0 ) {
+                                print_error("Unable to send data", -ev.res);
+                                ret = -1;
+                                break;
+                        }
+                        stats_add( &ctx->stats, 1, ev.res );
+                        if (is_flag(ctx->common.options, VERBOSE_FLAG) &&
+                                        !is_flag(ctx->common.options, REPORT_FLAG)) 
+                                print_output_verbose(&ctx->host, ev.res,
+                                                ctx->ppid, ctx->streamno);
+                } else {
+                        if ( ev.res <= 0 || (ev.len == 0 && 
+                                        !(ev.flags & MSG_NOTIFICATION))) {
+                                print_error("Unable to read received data", 
+                                                ev.res < 0 ? -ev.res : ECONNRESET );
+                                uring_done( eng, &ev );
+                                ret = -1;
+                                break;
+                        }
+                        if ( !(ev.flags & MSG_NOTIFICATION) ) 
+                                handle_echo( ctx, ev.data, ev.len, ev.flags, 
+                                                &ev.peer, &ev.info );
+                        uring_done( eng, &ev );
+                        active_ns = time_now_ns();
+                }
+                latency_tick( ctx );
+                stats_tick( &ctx->stats, "" );
+        }
+        if ( is_flag( ctx->common.options, REPORT_FLAG ))
+                stats_final( &ctx->stats, "" );
+        latency_finish( ctx );
+out :
+        uring_stop( eng );
+        uring_delete( eng );
+        payload_free( &ctx->payload );
+        keep_connection( ctx );
+        close( ctx->common.sock );
+        ctx->common.sock = -1;
+        return ret;
+}
+#endif /* HAVE_URING */
+
+#ifdef HAVE_EPOLL
+/**
+ * State for one association in the multi-association mode.
+ */
+struct client_assoc {
+        int id; /**< Number of the association */
+        int sock; /**< Socket for the association */
+        int connected; /**< 1 when the connection is established */
+        int partial; /**< 1 if in middle of partially received echo */
+        uint32_t inflight; /**< Number of echoes in flight */
+        int done; /**< 1 when all data has been sent (and echoed) */
+        uint32_t sent; /**< Number of messages sent */
+        uint32_t echoed; /**< Number of echoes received */
+        uint32_t timeouts; /**< Number of echoes timed out */
+        uint64_t bytes_sent; /**< Number of payload bytes sent */
+        uint64_t bytes_recv; /**< Number of payload bytes received */
+        uint64_t start_ns; /**< Time the first message was sent */
+        uint64_t end_ns; /**< Time the association completed */
+        uint64_t active_ns; /**< Time the last message was sent or received */
+};
+
+/**
+ * Update the events the association is waiting for on epoll set.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param epfd The epoll instance.
+ * @param as The association.
+ * @param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * @param can_send 0 if the pacer does not allow sending now.
+ * @return -1 on error, 0 on success.
+ */
+static int assoc_update_events( struct client_ctx *ctx, int epfd,
+                struct client_assoc *as, int op, int can_send )
+{
+        struct epoll_event ev;
+
+        memset( &ev, 0, sizeof(ev));
+        ev.data.ptr = as;
+        if ( !as->connected || (can_send && as->inflight < ctx->window &&
+                                as->sent < ctx->chunk_count ))
+                ev.events |= EPOLLOUT;
+        if ( as->inflight > 0 )
+                ev.events |= EPOLLIN;
+
+        if ( epoll_ctl( epfd, op, as->sock, &ev ) < 0 ) {
+                print_error("Unable to update epoll set", errno);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Mark the association done and remove it from the epoll set.
+ *
+ * @param epfd The epoll instance.
+ * @param as The association.
+ */
+static void assoc_done( int epfd, struct client_assoc *as )
+{
+        as->done = 1;
+        as->end_ns = time_now_ns();
+        epoll_ctl( epfd, EPOLL_CTL_DEL, as->sock, NULL );
+}
+
+/**
+ * Create the socket for the association and start connecting it.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param as The association.
+ * @param addrlen Length of the remote address.
+ * @return -1 on error, 0 on success.
+ */
+static int assoc_open( struct client_ctx *ctx, struct client_assoc *as,
+                socklen_t addrlen )
+{
+        int ret;
+
+        as->sock = common_create_socket( &ctx->common );
+        if ( as->sock < 0 )
+                return -1;
+
+        if (is_flag(ctx->common.options, (VERBOSE_FLAG|ECHO_FLAG))) 
+                subscribe_io_events( as->sock, 0 );
+
+        if ( fcntl( as->sock, F_SETFL, 
+                                fcntl( as->sock, F_GETFL ) | O_NONBLOCK ) < 0 ) {
+                print_error("Unable to set socket non-blocking", errno);
+                return -1;
+        }
+        if ( ctx->common.laddrs.count > 0 && 
+                        common_bindx( as->sock, &ctx->common.laddrs, 0 ) < 0 )
+                return -1;
+        if ( is_flag( ctx->common.options, SEQ_FLAG ) ) {
+                /* association is set up with the first message */
+                as->connected = 1;
+                if ( ctx->peers.count > 1 && 
+                                common_connectx( as->sock, &ctx->peers, ctx->port ) < 0 &&
+                                errno != EINPROGRESS ) {
+                        print_error("Unable to connect to the peer addresses", errno);
+                        return -1;
+                }
+                return 0;
+        }
+        if ( ctx->peers.count > 1 )
+                ret = common_connectx( as->sock, &ctx->peers, ctx->port );
+        else 
+                ret = connect( as->sock, (struct sockaddr *)&(ctx->host), addrlen );
+        if ( ret < 0 ) {
+                if ( errno != EINPROGRESS ) {
+                        print_error("Unable to connect()", errno);
+                        return -1;
+                }
+        } else {
+                as->connected = 1;
+        }
+        return 0;
+}
+
+/**
+ * Handle write readiness of the association.
+ *
+ * Complete the pending connect() or send next message, if the pacer
+ * allows.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param as The association.
+ * @param addrlen Length of the remote address.
+ * @return -1 on error, 0 on success.
+ */
+static int assoc_send( struct client_ctx *ctx, struct client_assoc *as,
+                socklen_t addrlen )
+{
+        uint8_t *msg;
+        int ret, err;
+        socklen_t errlen;
+        uint64_t now;
+
+        if ( !as->connected ) {
+                errlen = sizeof(err);
+                if ( getsockopt( as->sock, SOL_SOCKET, SO_ERROR, 
+                                        &err, &errlen ) < 0 ) 
+                        err = errno;
+                if ( err != 0 ) {
+                        fprintf(stderr, "Association %d: unable to connect: %s\n",
+                                        as->id, strerror(err));
+                        return -1;
+                }
+                as->connected = 1;
+                return 0;
+        }
+        if ( as->sent >= ctx->chunk_count || as->inflight >= ctx->window )
+                return 0;
+        if ( ctx->paced ) {
+                now = time_now_ns();
+                if ( pacer_due( &ctx->pacer, now ) > now )
+                        return 0;
+        }
+
+        msg = payload_next( &ctx->payload );
+        if ( ctx->stamp )
+                latency_stamp( ctx, msg );
+        ret = sendit( as->sock, ctx->ppid, ctx->streamno, ctx->msg_seq++,
+                        send_dst( ctx ), addrlen, 
+                        msg, ctx->chunk_size );
+        if ( ret < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                        return 0;
+
+                print_error("Unable to send data", errno);
+                return -1;
+        }
+        if ( ctx->paced )
+                pacer_advance( &ctx->pacer );
+        if ( as->sent == 0 )
+                as->start_ns = time_now_ns();
+
+        as->sent++;
+        as->bytes_sent += ret;
+        stats_add( &ctx->stats, 1, ret );
+        if (is_flag(ctx->common.options, VERBOSE_FLAG) &&
+                        !is_flag(ctx->common.options, REPORT_FLAG)) 
+                print_output_verbose(&ctx->host, ret, ctx->ppid, ctx->streamno);
+
+        if ( is_flag( ctx->common.options, ECHO_FLAG ) ) {
+                as->inflight++;
+                as->active_ns = time_now_ns();
+        }
+        return 0;
+}
 
 /**
- * Number of milliseconds to wait for reply in echo mode.
- */
-#define ECHO_WAIT_MS 500
-/**
- * Default size for chunk to send.
+ * Read the echo for the association.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param as The association.
+ * @param chunk Buffer for the data.
+ * @return -1 on error, 0 on success.
  */
-#define DEFAULT_CHUNK_SIZE 120
+static int assoc_recv( struct client_ctx *ctx, struct client_assoc *as,
+                uint8_t *chunk )
+{
+        struct sockaddr_storage peer;
+        struct sctp_sndrcvinfo info;
+        socklen_t peer_len;
+        int ret, flags;
+
+        memset( &peer, 0, sizeof(peer));
+        memset( &info, 0, sizeof(info));
+        peer_len = sizeof(peer);
+        flags = 0;
+        ret = sctp_recvmsg( as->sock, chunk, ctx->recvbuf_size, 
+                        (struct sockaddr *)&peer, &peer_len, &info, &flags );
+        if ( ret < 0 ) {
+                if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                        return 0;
+
+                print_error("Unable to read received data", errno);
+                return -1;
+        } else if ( ret == 0 ) {
+                fprintf(stderr, "Association %d: closed by remote host\n", as->id);
+                return -1;
+        }
+        if (is_flag(ctx->common.options, VERBOSE_FLAG) &&
+                        !is_flag(ctx->common.options, REPORT_FLAG))
+                print_input(&peer, ret, flags, &info);
+
+        as->bytes_recv += ret;
+        as->active_ns = time_now_ns();
+        if ( ctx->latency )
+                latency_record( ctx, chunk, ret, !as->partial );
+        as->partial = !(flags & MSG_EOR);
+        if ( !as->partial ) {
+                as->echoed++;
+                if ( as->inflight > 0 )
+                        as->inflight--;
+        }
+        return 0;
+}
+
 /**
- * Default number of packets to send.
+ * Print the throughput of the association.
+ *
+ * @param name Name to print for the association.
+ * @param msgs Number of messages sent.
+ * @param bytes Number of bytes sent.
+ * @param elapsed_ns Time it took to send the data.
  */
-#define DEFAULT_COUNT 5
+static void print_throughput( const char *name, uint64_t msgs, uint64_t bytes,
+                uint64_t elapsed_ns )
+{
+        double secs = (double)elapsed_ns / NSEC_PER_SEC;
+
+        if ( secs <= 0 )
+                secs = 1.0 / NSEC_PER_SEC;
+
+        printf("%-14s: %8" PRIu64 " msgs %12" PRIu64 " bytes in %8.3f s "
+                        "%10.1f msgs/s %10.3f Mbit/s\n", name, msgs, bytes, secs,
+                        msgs / secs, (bytes * 8) / secs / 1000000 );
+}
 
 /**
- * Main context for the client.
+ * Check if the pacer allows sending now, if not, arm the timer to expire
+ * when the next send slot is due.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param tfd The timerfd.
+ * @return 1 if messages can be sent, 0 if not.
  */
-struct client_ctx {
-        struct sockaddr_storage host; /**< Remote host address */
-        uint16_t port;/**< Port number for remote host */
-        uint16_t lport; /**< Port number for local port or 0 */
-        uint16_t chunk_size; /**< Number of bytes to send on each write */
-        uint16_t chunk_count;/**< Number of writes to do */
-        char filename[FILENAME_LEN]; /**< File to read data from */
-        uint32_t ppid; /**< PPID to set to the packet. */
-        uint16_t streamno; /**< Stream id to set to the packet. */
-        struct common_context common; /**< Context common for client and server*/
-};
+static int pacer_check( struct client_ctx *ctx, int tfd )
+{
+        struct itimerspec its;
+        uint64_t now, due;
+
+        if ( !ctx->paced )
+                return 1;
+
+        now = time_now_ns();
+        due = pacer_due( &ctx->pacer, now );
+        if ( due <= now )
+                return 1;
+
+        memset( &its, 0, sizeof(its));
+        its.it_value.tv_sec = due / NSEC_PER_SEC;
+        its.it_value.tv_nsec = due % NSEC_PER_SEC;
+        if ( timerfd_settime( tfd, TFD_TIMER_ABSTIME, &its, NULL ) < 0 ) 
+                print_error("Unable to set timer", errno);
+
+        return 0;
+}
 
 /**
- * Do the client operation. 
+ * Do the client operation with multiple concurrent associations. 
  *
- * Send the required data and, if in echo mode, wait for reply packets.
+ * Each association is driven from single epoll loop using non-blocking
+ * sockets. Each association sends the requested number of messages, in echo
+ * mode at most ctx->window messages per association are waiting for
+ * echo. If rate or bandwidth is given, it is the aggregate over all
+ * associations, a timerfd wakes the loop up when next send slot is due.
  *
  * @param ctx Pointer to the main client context.
  * @return -1 on error, 0 on success.
  */
-static int do_client( struct client_ctx *ctx )
+static int do_client_multi( struct client_ctx *ctx )
 {
+        struct epoll_event events[MULTI_MAX_EVENTS], ev;
+        struct client_assoc *assocs, *as;
         socklen_t addrlen;
-        int ret,fd,i,recv_len,recv_flags;
+        int epfd, tfd = -1, i, n, active, can_send, ret = 0;
+        uint64_t expirations;
+        uint64_t now, first_ns = 0, last_ns = 0, msgs = 0, bytes = 0;
         uint8_t *chunk;
-        struct sockaddr_storage peer;
-        struct sctp_sndrcvinfo info;
-        socklen_t peer_len;
+        char name[20];
 
         if ( ctx->host.ss_family == AF_INET )
                 addrlen = sizeof( struct sockaddr_in);
         else
                 addrlen = sizeof( struct sockaddr_in6);
 
-        if ( ! is_flag( ctx->common.options, SEQ_FLAG ) ) {
-                ret = connect( ctx->common.sock,
-                              (struct sockaddr *)&(ctx->host), addrlen );
-                if ( ret < 0 ) {
-                        print_error("Unable to connect()", errno);
+        TRACE("Reading data from %s \n", ctx->filename );
+        if ( payload_init( &ctx->payload, ctx->filename, ctx->chunk_size ) < 0 ) {
+                print_error("Unable to load data to send", errno);
+                return -1;
+        }
+        epfd = epoll_create1( 0 );
+        if ( epfd < 0 ) {
+                print_error("Unable to create epoll instance", errno);
+                payload_free( &ctx->payload );
+                return -1;
+        }
+        if ( ctx->paced ) {
+                tfd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+                memset( &ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.ptr = NULL;
+                if ( tfd < 0 || epoll_ctl( epfd, EPOLL_CTL_ADD, tfd, &ev ) < 0 ) {
+                        print_error("Unable to create timer", errno);
+                        if ( tfd >= 0 )
+                                close( tfd );
+                        close( epfd );
+                        payload_free( &ctx->payload );
                         return -1;
                 }
+                pacer_start( &ctx->pacer, time_now_ns());
         }
+        if ( ctx->latency )
+                latency_start( ctx );
+        stats_init( &ctx->stats, ctx->common.interval_ns );
+        chunk = mem_alloc( ctx->recvbuf_size );
+        assocs = mem_zalloc( ctx->associations * sizeof(*assocs));
+        for ( i = 0; i < ctx->associations; i++ ) 
+                assocs[i].sock = -1;
 
-        TRACE("Reading data from %s \n", ctx->filename );
-        fd = open( ctx->filename, O_RDONLY);
-        if ( fd < 0 ) {
-                WARN("Can't open file %s : %s \n",ctx->filename, strerror(errno));
-                print_error("Unable to open file", errno);
-                return -1;
+        active = 0;
+        for ( i = 0; i < ctx->associations; i++ ) {
+                as = &assocs[i];
+                as->id = i;
+                if ( assoc_open( ctx, as, addrlen ) < 0 || 
+                                assoc_update_events( ctx, epfd, as, EPOLL_CTL_ADD, 1 ) < 0 ) {
+                        ret = -1;
+                        goto out;
+                }
+                if ( ctx->chunk_count == 0 ) 
+                        assoc_done( epfd, as );
+                else 
+                        active++;
         }
+        printf("Running %d associations\n", ctx->associations );
+        common_prepare_io( &ctx->common, 0 );
 
-        chunk = mem_alloc( ctx->chunk_size );
-
-        for( i = 0; i < ctx->chunk_count; i++ ) {
+        while ( active > 0 ) {
+                n = epoll_wait( epfd, events, MULTI_MAX_EVENTS, ECHO_WAIT_MS );
+                if ( n < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
 
-                ret = read( fd, chunk, ctx->chunk_size );
-                if ( ret < 0 ) {
-                        print_error("Unable to read data to send", errno);
+                        print_error("Error in epoll_wait()", errno);
+                        ret = -1;
                         break;
                 }
-
-                DBG("Sending %d bytes \n", ret );
-                if (is_flag(ctx->common.options, XDUMP_FLAG ))
-                        xdump_data( stdout, chunk, ret, "Data to send");
-
-                printf("Sending chunk %d/%d \n", (i+1), ctx->chunk_count);
-
-                ret = sendit( ctx->common.sock, ctx->ppid, ctx->streamno, 
-                                (struct sockaddr *)&ctx->host, addrlen, 
-                                chunk, ctx->chunk_size );
-
-                if ( ret < 0 ) {
-                        print_error("Unable to send data", errno);
-                        break;
+                for ( i = 0; i < n; i++ ) {
+                        as = events[i].data.ptr;
+                        if ( as == NULL ) {
+                                /* pacing timer expired */
+                                if ( read( tfd, &expirations, 
+                                           sizeof(expirations)) < 0 ) {
+                                        TRACE("Timer read failed\n");
+                                }
+                                continue;
+                        }
+                        if ( events[i].events & EPOLLIN ) 
+                                ret = assoc_recv( ctx, as, chunk );
+                        if ( ret == 0 && 
+                             (events[i].events & (EPOLLOUT|EPOLLERR|EPOLLHUP)) )
+                                ret = assoc_send( ctx, as, addrlen );
+                        if ( ret < 0 ) 
+                                goto out;
                 }
-                if (is_flag(ctx->common.options, VERBOSE_FLAG)) 
-                        print_output_verbose(&ctx->host, ctx->chunk_size,
-                                        ctx->ppid, ctx->streamno);
-
-
-                if ( is_flag( ctx->common.options, ECHO_FLAG ) ) {
-                        memset( &peer, 0, sizeof(peer));
-                        memset( &info, 0, sizeof(info));
-                        peer_len = addrlen;
-                        recv_flags = 0;
-                        recv_len = recv_wait( ctx->common.sock, 
-                                        ECHO_WAIT_MS, chunk, ctx->chunk_size, 
-                                        (struct sockaddr *)&peer, &peer_len,
-                                        &info,&recv_flags);
-
-                        if ( recv_len < 0 ) {
-                                WARN("Error while receiving data\n");
-                                print_error("Unable to read received data", errno);
-                                break;
-                        } else if ( recv_len == 0 ) {
-                                printf("Timed out while waiting for echo\n");
-                        } else {
-                                if (is_flag(ctx->common.options, VERBOSE_FLAG))
-                                        print_input(&peer, recv_len, recv_flags,&info);
+                latency_tick( ctx );
+                stats_tick( &ctx->stats, "" );
+                can_send = pacer_check( ctx, tfd );
+                /* read after the events, active_ns may have been updated */
+                now = time_now_ns();
+                for ( i = 0; i < ctx->associations; i++ ) {
+                        as = &assocs[i];
+                        if ( as->done ) 
+                                continue;
 
-                                printf("Received %d bytes of possible echo\n", recv_len);
-                                if (is_flag(ctx->common.options, XDUMP_FLAG))
-                                        xdump_data(stdout,chunk, recv_len, "Received data");
+                        if ( as->inflight > 0 && 
+                             now - as->active_ns > ECHO_WAIT_MS * 1000000ULL ) {
+                                as->timeouts += as->inflight;
+                                as->inflight = 0;
+                                as->partial = 0;
+                        }
+                        if ( as->sent == ctx->chunk_count && as->inflight == 0 ) {
+                                assoc_done( epfd, as );
+                                active--;
+                        } else if ( assoc_update_events( ctx, epfd, as, 
+                                                EPOLL_CTL_MOD, can_send ) < 0 ) {
+                                ret = -1;
+                                goto out;
                         }
                 }
         }
-        close( fd );
 
-        if ( is_flag( ctx->common.options, KEEP_FLAG ) ) {
-                printf("Press any key to terminate the client ...\n");
-                ret = read( 0, chunk, 1 );
-                if ( ret < 0 ) {
-                        WARN("read() failed : %s \n", strerror(errno));
-                }
-        }
-        close( ctx->common.sock );
-        ctx->common.sock = -1;
+        for ( i = 0; i < ctx->associations; i++ ) {
+                as = &assocs[i];
+                snprintf( name, sizeof(name), "Association %d", as->id );
+                print_throughput( name, as->sent, as->bytes_sent, 
+                                as->end_ns - as->start_ns );
+                if ( is_flag( ctx->common.options, ECHO_FLAG ))
+                        printf("%-14s: %8" PRIu32 " echoes, %" PRIu32 " timed out\n",
+                                        "", as->echoed, as->timeouts );
 
-        return 0;
+                if ( first_ns == 0 || as->start_ns < first_ns )
+                        first_ns = as->start_ns;
+                if ( as->end_ns > last_ns )
+                        last_ns = as->end_ns;
+                msgs += as->sent;
+                bytes += as->bytes_sent;
+        }
+        print_throughput( "Total", msgs, bytes, last_ns - first_ns );
+        if ( is_flag( ctx->common.options, REPORT_FLAG ))
+                stats_final( &ctx->stats, "" );
+out :
+        latency_finish( ctx );
+        for ( i = 0; i < ctx->associations; i++ ) {
+                if ( assocs[i].sock >= 0 )
+                        close( assocs[i].sock );
+        }
+        mem_free( assocs );
+        mem_free( chunk );
+        if ( tfd >= 0 )
+                close( tfd );
+        close( epfd );
+        payload_free( &ctx->payload );
+        return ret;
 }
+#endif /* HAVE_EPOLL */
 
 /**
  * Print help for command line options.
@@ -217,9 +1670,16 @@ static void print_usage()
         printf("Available options are:\n");
         printf("\t--port <port>  : Destination port is <port> \n");
         printf("\t--lport <port> : Bind to local port <port> \n");
-        printf("\t--host <host>  : Remote host to connect is <host>\n");
+        printf("\t--host <host>  : Remote host to connect is <host>, can be given up to\n");
+        printf("\t                 %d times for the addresses of a multihomed host\n", MAX_ADDRS);
         printf("\t--size <size>  : Size of the chunk to send is <size>, default %d\n",
                         DEFAULT_CHUNK_SIZE);
+        printf("\t--segment <n>  : Send the chunks as segments of <n> bytes gathered\n");
+        printf("\t                 from <file>, default for chunks over %d bytes is %d\n",
+                        MAX_CONTIG_SIZE, DEFAULT_SEGMENT_SIZE);
+        printf("\t--eor          : Send the segments one by one with explicit EOR\n");
+        printf("\t--buf <size>   : Size of the buffer for received echoes, default is\n");
+        printf("\t                 the chunk size (at most %d)\n", MAX_CONTIG_SIZE + 1);
         printf("\t--count <cnt>  : Send <cnt> chunks, default is %d\n",
                         DEFAULT_COUNT);
         printf("\t--keep         : Keep the connection after all data chunks are sent\n");
@@ -229,6 +1689,33 @@ static void print_usage()
                         DEFAULT_PPID);
         printf("\t--streamid <s> : Send data to stream with id <d>, default is %d\n",
                         DEFAULT_STREAM_NO);
+#ifdef HAVE_EPOLL
+        printf("\t--associations <n> : Drive <n> associations concurrently\n");
+#endif /* HAVE_EPOLL */
+        printf("\t--rate <r>     : Send <r> messages per second (k, M suffix allowed)\n");
+        printf("\t--bandwidth <b>: Send payload at <b> bits per second (k, M, G suffix allowed)\n");
+        printf("\t--burst <n>    : Send at most <n> messages back-to-back to catch up the\n");
+        printf("\t                 rate, default %d\n", PACER_DEFAULT_BURST);
+        printf("\t--window <n>   : Keep at most <n> echoes in flight, default is 1\n");
+        printf("\t                 (unlimited with --rate or --bandwidth)\n");
+        printf("\t--latency      : Measure round-trip latency of echoed messages (implies --echo)\n");
+        printf("\t--streams <k>  : Spread the messages on streams 0 - <k>-1 (limited to the\n");
+        printf("\t                 negotiated outbound streams) and stamp them for the server\n");
+        printf("\t--stream-select <s> : Choose the stream by rr (default), hash or weights\n");
+        printf("\t                 for streams 0, 1, ... given as comma separated list,\n");
+        printf("\t                 as 4,2,1,1 (with --control the weight of stream 0 is\n");
+        printf("\t                 not used, but must be given)\n");
+        printf("\t--stream-prio <v> : Scheduler values (see --sched) for streams 0, 1, ...\n");
+        printf("\t                 as comma separated list, priority or weight\n");
+        printf("\t--control <r>  : Send also %d byte control messages on stream 0 at rate\n",
+                        CONTROL_MSG_SIZE);
+        printf("\t                 <r>, the bulk messages are sent on streams 1 - <k>\n");
+        printf("\t                 (with --echo their round-trip time is reported)\n");
+        printf("\t--interleave-compare : With --control and --echo, run first without and then\n");
+        printf("\t                 with I-DATA and compare the control message RTT\n");
+        printf("\t--send-bench   : Time <cnt> sends with sctp_sendmsg() and <cnt> with the\n");
+        printf("\t                 cached SCTP_SNDINFO sendmsg() on the same socket\n");
+        printf("\t--failover <ms>: Report path changes and throughput stalls longer than <ms>\n");
         common_print_usage();
 }
 
@@ -245,7 +1732,9 @@ static int parse_args( int argc, char **argv, struct client_ctx *ctx )
 {
         int c, option_index,ret;
         int got_port = 0, got_addr = 0;
+        uint32_t ms;
         struct option long_options[] = {
+                COMMON_LONG_OPTIONS,
                 { "port", 1, 0, 'p' },
                 { "host", 1, 0, 'h' },
                 { "size",1,0,'s' },
@@ -265,6 +1754,27 @@ static int parse_args( int argc, char **argv, struct client_ctx *ctx )
                 { "auth-key",1,0,'A'},
                 { "auth-hmac",1,0,'M'},
                 { "auth-chunk",1,0,'C'},
+#ifdef HAVE_EPOLL
+                { "associations",1,0,'a'},
+#endif /* HAVE_EPOLL */
+                { "rate",1,0,'r'},
+                { "bandwidth",1,0,'B'},
+                { "burst",1,0,'u'},
+                { "latency",0,0,'l'},
+                { "window",1,0,'W'},
+                { "interval",1,0,'i'},
+                { "batch",1,0,'N'},
+                { "engine",1,0,'g'},
+                { "segment",1,0,'G'},
+                { "eor",0,0,'R'},
+                { "buf",1,0,'b'},
+                { "failover",1,0,'F'},
+                { "streams",1,0,'m'},
+                { "stream-select",1,0,'Y'},
+                { "stream-prio",1,0,'q'},
+                { "control",1,0,'Q'},
+                { "interleave-compare",0,0,'X'},
+                { "send-bench",0,0,'Z'},
 #ifdef DEBUG
                 { "debug",1,0,'D'},
 #endif /* DEBUG */
@@ -273,19 +1783,62 @@ static int parse_args( int argc, char **argv, struct client_ctx *ctx )
 
         while( 1 ) {
 
-                c = getopt_long(argc, argv, "p:h:c:s:HekSvTxf:I:O:D:A:M:C:",
+                c = getopt_long(argc, argv, "p:h:c:s:HekSvTxf:I:O:D:A:M:C:a:r:B:u:li:W:N:g:G:Rb:F:m:Y:q:Q:XZ",
                                 long_options, &option_index);
                 if ( c == -1 ) 
                         break;
 
                 switch ( c ) {
                         case 'h' :
-                                if ( resolve( optarg, &(ctx->host) ) < 0 ) {
-                                        fprintf(stderr, "Invalid IP address for host given\n");
+                                if ( addr_set_add( &ctx->peers, optarg ) < 0 ) {
+                                        fprintf(stderr, "Invalid IP address for host given "
+                                                        "(at most %d can be given)\n", MAX_ADDRS);
                                         return -1;
                                 }
+                                if ( !got_addr )
+                                        memcpy( &ctx->host, &ctx->peers.addrs[0], 
+                                                        sizeof(ctx->host));
                                 got_addr = 1;
                                 break;
+                        case 'm' :
+                                if ( parse_uint16( optarg, &ctx->sel.requested ) < 0 ||
+                                                ctx->sel.requested == 0 ) {
+                                        fprintf(stderr, "Invalid number of streams given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'Y' :
+                                if ( stream_sel_parse( &ctx->sel, optarg ) < 0 ) {
+                                        fprintf(stderr, "Invalid stream selection given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'q' :
+                                if ( stream_sel_parse_values( &ctx->sel, optarg ) < 0 ) {
+                                        fprintf(stderr, "Invalid stream scheduler values given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'Q' :
+                                if ( parse_rate( optarg, &ctx->ctrl_rate ) < 0 || 
+                                                ctx->ctrl_rate == 0 ) {
+                                        fprintf(stderr, "Invalid control message rate given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'X' :
+                                ctx->compare = 1;
+                                break;
+                        case 'Z' :
+                                ctx->send_bench = 1;
+                                break;
+                        case 'F' :
+                                if ( parse_uint32( optarg, &ms ) < 0 || ms == 0 ) {
+                                        fprintf(stderr, "Invalid stall threshold given\n");
+                                        return -1;
+                                }
+                                ctx->failover_ns = (uint64_t)ms * 1000000ULL;
+                                break;
                         case 'p' :
                                 if ( parse_uint16( optarg, &(ctx->port) ) < 0 ) {
                                         fprintf(stderr, "Malformed port given\n" );
@@ -306,14 +1859,32 @@ static int parse_args( int argc, char **argv, struct client_ctx *ctx )
                                 }
                                 break;
                         case 'c' :
-                                if ( parse_uint16( optarg, &(ctx->chunk_count) ) < 0 ) {
+                                if ( parse_uint32( optarg, &(ctx->chunk_count) ) < 0 ) {
                                        fprintf(stderr, "Illegal chunk count given\n");
                                       return -1;
                                 }
                                 break;
                         case 's' :
-                                if ( parse_uint16( optarg, &(ctx->chunk_size) ) < 0 ) {
-                                       fprintf(stderr, "Illegal chunk count given\n");
+                                if ( parse_uint32( optarg, &(ctx->chunk_size) ) < 0 ||
+                                                ctx->chunk_size == 0 ) {
+                                       fprintf(stderr, "Illegal chunk size given\n");
+                                      return -1;
+                                }
+                                break;
+                        case 'G' :
+                                if ( parse_uint32( optarg, &(ctx->segment) ) < 0 ||
+                                                ctx->segment == 0 ) {
+                                       fprintf(stderr, "Illegal segment size given\n");
+                                      return -1;
+                                }
+                                break;
+                        case 'R' :
+                                ctx->eor = 1;
+                                break;
+                        case 'b' :
+                                if ( parse_uint32( optarg, &(ctx->recvbuf_size) ) < 0 ||
+                                                ctx->recvbuf_size == 0 ) {
+                                       fprintf(stderr, "Illegal recv buffer size given\n");
                                       return -1;
                                 }
                                 break;
@@ -330,6 +1901,48 @@ static int parse_args( int argc, char **argv, struct client_ctx *ctx )
                                         return -1;
                                 }
                                 break;
+#ifdef HAVE_EPOLL
+                        case 'a' :
+                                if (parse_uint16(optarg, &ctx->associations) < 0 ||
+                                                ctx->associations == 0) {
+                                        fprintf(stderr,"Invalid number of associations given\n");
+                                        return -1;
+                                }
+                                break;
+#endif /* HAVE_EPOLL */
+                        case 'r' :
+                                if ( parse_rate( optarg, &ctx->rate ) < 0 || 
+                                                ctx->rate == 0 ) {
+                                        fprintf(stderr, "Invalid rate given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'B' :
+                                if ( parse_rate( optarg, &ctx->bandwidth ) < 0 || 
+                                                ctx->bandwidth == 0 ) {
+                                        fprintf(stderr, "Invalid bandwidth given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'u' :
+                                if ( parse_uint32( optarg, &ctx->burst ) < 0 ||
+                                                ctx->burst == 0 ) {
+                                        fprintf(stderr, "Invalid burst size given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'l' :
+                                ctx->latency = 1;
+                                ctx->common.options = set_flag( ctx->common.options, 
+                                                ECHO_FLAG );
+                                break;
+                        case 'W' :
+                                if ( parse_uint32( optarg, &ctx->window ) < 0 ||
+                                                ctx->window == 0 ) {
+                                        fprintf(stderr, "Invalid window size given\n");
+                                        return -1;
+                                }
+                                break;
                         case 'H' :
                                 print_usage();
                                 return 0;
@@ -353,6 +1966,131 @@ static int parse_args( int argc, char **argv, struct client_ctx *ctx )
                 fprintf(stderr, "No destination address given\n");
                 return -1;
         }
+        if ( ctx->associations > 1 && ctx->lport != 0 ) {
+                fprintf(stderr, "Local port can not be used with multiple associations\n");
+                return -1;
+        }
+        if ( ctx->common.batch > 0 && (!is_flag( ctx->common.options, SEQ_FLAG ) ||
+                                ctx->associations > 1 )) {
+                fprintf(stderr, "Batching is supported only with --seq and single association\n");
+                return -1;
+        }
+        if ( ctx->common.engine != ENGINE_CLASSIC && 
+                        (ctx->associations > 1 || ctx->common.batch > 0 )) {
+                fprintf(stderr, "The I/O engine can not be combined with multiple associations or --batch\n");
+                return -1;
+        }
+        if ( ctx->compare ) {
+                if ( ctx->ctrl_rate == 0 || 
+                                !is_flag( ctx->common.options, ECHO_FLAG )) {
+                        fprintf(stderr, "Interleave comparison needs --control and --echo\n");
+                        return -1;
+                }
+                if ( !(ctx->common.tuning.set & TUNE_FRAG_INTERLEAVE)) {
+                        ctx->common.tuning.frag_interleave = 2;
+                        ctx->common.tuning.set |= TUNE_FRAG_INTERLEAVE;
+                }
+        }
+        if ( ctx->ctrl_rate > 0 ) {
+                /* the bulk goes to the streams after the control stream */
+                ctx->sel.first = 1;
+                pacer_init_rate( &ctx->ctrl_pacer, ctx->ctrl_rate, 1 );
+        }
+        if ( ctx->sel.mode == STREAM_SEL_WEIGHTS ) {
+                /* the weights are given for streams 0, 1, ... */
+                if ( ctx->sel.requested == 0 && 
+                                ctx->sel.weight_count > ctx->sel.first ) 
+                        ctx->sel.requested = ctx->sel.weight_count - ctx->sel.first;
+                if ( ctx->sel.requested == 0 || ctx->sel.requested + 
+                                ctx->sel.first != ctx->sel.weight_count ) {
+                        fprintf(stderr, "Number of stream weights should match --streams "
+                                        "(plus the control stream with --control)\n");
+                        return -1;
+                }
+        }
+        if ( ctx->ctrl_rate > 0 && ctx->sel.requested == 0 )
+                ctx->sel.requested = 1;
+        if ( ctx->sel.value_count > 0 && ctx->sel.requested == 0 ) {
+                fprintf(stderr, "Stream scheduler values can be used only with --streams or --control\n");
+                return -1;
+        }
+        if ( ctx->sel.requested > 0 && (ctx->common.engine != ENGINE_CLASSIC ||
+                                ctx->associations > 1 )) {
+                fprintf(stderr, "Multiple streams can not be combined with --engine or multiple associations\n");
+                return -1;
+        }
+        if ( ctx->failover_ns > 0 && (ctx->common.engine != ENGINE_CLASSIC || 
+                                ctx->associations > 1 || 
+                                is_flag( ctx->common.options, ECHO_FLAG ))) {
+                fprintf(stderr, "Failover mode can not be combined with --echo, --engine or multiple associations\n");
+                return -1;
+        }
+        if ( is_flag( ctx->common.options, BUSY_POLL_FLAG ) && 
+                        (ctx->common.engine != ENGINE_CLASSIC || ctx->associations > 1 )) {
+                fprintf(stderr, "Busy poll can not be combined with --engine or multiple associations\n");
+                return -1;
+        }
+        if ( ctx->segment == 0 && (ctx->eor || ctx->chunk_size > MAX_CONTIG_SIZE))
+                ctx->segment = DEFAULT_SEGMENT_SIZE;
+        if ( ctx->segment > 0 ) {
+                if ( ctx->segment > ctx->chunk_size ) 
+                        ctx->segment = ctx->chunk_size;
+                if ( ctx->associations > 1 || ctx->common.batch > 0 || 
+                                ctx->common.engine != ENGINE_CLASSIC ) {
+                        fprintf(stderr, "Large messages can not be sent with multiple associations, --batch or --engine\n");
+                        return -1;
+                }
+                if ( !ctx->eor && (ctx->chunk_size - 1) / ctx->segment >= LARGE_IOV_MAX ) {
+                        fprintf(stderr, "Chunk has more than %d segments, use larger --segment or --eor\n",
+                                        LARGE_IOV_MAX);
+                        return -1;
+                }
+        }
+        if ( ctx->send_bench && (ctx->associations > 1 || ctx->common.batch > 0 ||
+                                ctx->common.engine != ENGINE_CLASSIC || ctx->segment > 0 ||
+                                is_flag( ctx->common.options, ECHO_FLAG ) || 
+                                ctx->ctrl_rate > 0 || ctx->compare ||
+                                ctx->common.send.flags != 0 || 
+                                ctx->common.send.pr_policy != SCTP_PR_SCTP_NONE )) {
+                fprintf(stderr, "Send benchmark can be run only with plain single association sends\n");
+                return -1;
+        }
+        if ( ctx->recvbuf_size == 0 ) 
+                ctx->recvbuf_size = ctx->chunk_size > MAX_CONTIG_SIZE ? 
+                        MAX_CONTIG_SIZE + 1 : ctx->chunk_size;
+        if ( ctx->latency && (ctx->chunk_size < sizeof(struct latency_hdr) ||
+                        ctx->recvbuf_size < sizeof(struct latency_hdr) ||
+                        (ctx->segment > 0 && ctx->segment < sizeof(struct latency_hdr)))) {
+                fprintf(stderr, "Chunk, segment and buffer sizes must be at least %zu bytes for latency measurement\n",
+                                sizeof(struct latency_hdr));
+                return -1;
+        }
+        /* the server measures the delivery latency per stream from the
+         * stamp, if there is room for it */
+        ctx->stamp = ctx->latency || (ctx->sel.requested > 0 && 
+                        ctx->chunk_size >= sizeof(struct latency_hdr) &&
+                        (ctx->segment == 0 || ctx->segment >= sizeof(struct latency_hdr)));
+        ctx->stream = ctx->streamno;
+        /* the notifications are read on the single association loop, 
+         * the failover thread reads them on failover mode */
+        ctx->send_acct = (ctx->common.send.flags != 0 || 
+                        ctx->common.send.pr_policy != SCTP_PR_SCTP_NONE) &&
+                ctx->common.engine == ENGINE_CLASSIC && 
+                ctx->associations <= 1 && ctx->failover_ns == 0;
+        if ( ctx->rate != 0 && ctx->bandwidth != 0 ) {
+                fprintf(stderr, "Only one of rate and bandwidth can be given\n");
+                return -1;
+        }
+        if ( ctx->rate != 0 ) {
+                pacer_init_rate( &ctx->pacer, ctx->rate, ctx->burst );
+                ctx->paced = 1;
+        } else if ( ctx->bandwidth != 0 ) {
+                pacer_init_bandwidth( &ctx->pacer, ctx->bandwidth, 
+                                ctx->chunk_size, ctx->burst );
+                ctx->paced = 1;
+        }
+        if ( ctx->window == 0 ) 
+                ctx->window = ctx->paced ? UINT32_MAX : 1;
 
         return 1;
 }
@@ -399,19 +2137,196 @@ static int bind_to_local_port( int domain, int sock, uint16_t port)
         return 0;
 }
 
+/**
+ * Create the socket, bind it to the local addresses or port and subscribe
+ * to the events needed.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param domain Protocol family of the server address.
+ * @return -1 on error, 0 on success.
+ */
+static int open_socket( struct client_ctx *ctx, int domain )
+{
+        if (common_init(&ctx->common) != 0)
+                return -1;
+
+        if (ctx->common.laddrs.count > 0) {
+                if (common_bindx(ctx->common.sock, &ctx->common.laddrs, ctx->lport) != 0) 
+                        goto err;
+        } else if (ctx->lport != 0 ) {
+                if (bind_to_local_port(domain, ctx->common.sock, ctx->lport) != 0 ) 
+                        goto err;
+        }
+
+        /* the stream of the echoes is needed to track partial echoes */
+        if (is_flag(ctx->common.options, VERBOSE_FLAG) || 
+                        is_flag(ctx->common.options, ECHO_FLAG) || ctx->send_acct) 
+                subscribe_io_events(ctx->common.sock, ctx->send_acct);
+        return 0;
+err:
+        close(ctx->common.sock);
+        ctx->common.sock = -1;
+        return -1;
+}
+
+/**
+ * Clear the counters of the previous run before the next one.
+ *
+ * @param ctx Pointer to the main client context.
+ */
+static void reset_run( struct client_ctx *ctx )
+{
+        ctx->inflight = 0;
+        ctx->echo_timeouts = 0;
+        memset( ctx->echo_partial, 0, sizeof(ctx->echo_partial));
+        ctx->lat_seq = 0;
+        ctx->lat_unmatched = 0;
+        ctx->msg_seq = 0;
+        ctx->ctrl_sent = 0;
+        ctx->event_partial = 0;
+        ctx->event_check_ns = 0;
+        ctx->abandoned_unsent = 0;
+        ctx->abandoned_sent = 0;
+        ctx->sel.count = 0;
+}
+
+/**
+ * Run the mixed workload twice, first with DATA and then with I-DATA
+ * chunks, and compare the round-trip times of the control messages.
+ *
+ * The fragment interleave level is the same on both runs, only the
+ * SCTP_INTERLEAVING_SUPPORTED differs. The server should be run with
+ * --interleave for I-DATA to be negotiated.
+ *
+ * @param ctx Pointer to the main client context.
+ * @param domain Protocol family of the server address.
+ * @return -1 on error, 0 on success.
+ */
+static int do_interleave_compare( struct client_ctx *ctx, int domain )
+{
+        struct histogram *lat[2];
+        const char *labels[2] = { "Control RTT with DATA", "Control RTT with I-DATA" };
+        int run, ret = 0;
+
+        lat[0] = hist_create();
+        lat[1] = hist_create();
+        for ( run = 0; run < 2 && ret == 0; run++ ) {
+                if ( run == 0 )
+                        ctx->common.tuning.set &= ~(TUNE_INTERLEAVE);
+                else
+                        ctx->common.tuning.set |= TUNE_INTERLEAVE;
+
+                printf("Run %d: I-DATA interleaving %s\n", run + 1, 
+                                run == 0 ? "off" : "on");
+                reset_run( ctx );
+                if ( open_socket( ctx, domain ) < 0 )
+                        ret = -1;
+                else {
+                        ctx->ctrl_lat = lat[run];
+                        ret = do_client( ctx );
+                        ctx->ctrl_lat = NULL;
+                }
+        }
+        if ( ret == 0 ) {
+                printf("Comparison of %d byte control messages behind %" PRIu32 
+                                " byte messages:\n", CONTROL_MSG_SIZE, ctx->chunk_size );
+                hist_print( stdout, labels[0], lat[0] );
+                hist_print( stdout, labels[1], lat[1] );
+                if ( lat[0]->total > 0 && lat[1]->total > 0 )
+                        printf("I-DATA changes p99 %.1f -> %.1f us, max %.1f -> %.1f us\n",
+                                        hist_percentile( lat[0], 99.0 ) / 1000.0,
+                                        hist_percentile( lat[1], 99.0 ) / 1000.0,
+                                        lat[0]->max / 1000.0, lat[1]->max / 1000.0 );
+        }
+        hist_delete( lat[0] );
+        hist_delete( lat[1] );
+        return ret;
+}
+
+/**
+ * Compare the cost of sending with sctp_sendmsg() and with sendit().
+ *
+ * The same messages are sent on the same socket, alternating between the
+ * two in blocks of SEND_BENCH_BLOCK messages so that the state of the
+ * association affects both alike. Only the time spent in the send calls
+ * is counted. The server should consume the data fast enough for the
+ * sends not to block on a full send buffer.
+ *
+ * @param ctx Pointer to the main client context.
+ * @return -1 on error, 0 on success.
+ */
+static int do_send_bench( struct client_ctx *ctx )
+{
+        const char *names[2] = { "sctp_sendmsg()", "sendit()" };
+        uint64_t elapsed[2] = { 0, 0 }, sent[2] = { 0, 0 };
+        uint64_t start;
+        socklen_t addrlen;
+        uint32_t i, j, n;
+        int m, ret = 0;
+        uint8_t *msg;
+
+        if ( connect_host( ctx, &addrlen ) < 0 )
+                return -1;
+        if ( payload_init( &ctx->payload, ctx->filename, ctx->chunk_size ) < 0 ) {
+                print_error("Unable to load data to send", errno);
+                return -1;
+        }
+        common_prepare_io( &ctx->common, 0 );
+
+        for ( i = 0; i < ctx->chunk_count && ret == 0; i += n ) {
+                n = ctx->chunk_count - i;
+                if ( n > SEND_BENCH_BLOCK )
+                        n = SEND_BENCH_BLOCK;
+                for ( m = 0; m < 2 && ret == 0; m++ ) {
+                        start = time_now_ns();
+                        for ( j = 0; j < n; j++ ) {
+                                msg = payload_next( &ctx->payload );
+                                if ( m == 0 ) 
+                                        ret = sctp_sendmsg( ctx->common.sock, msg, 
+                                                        ctx->chunk_size, send_dst( ctx ), 
+                                                        addrlen, ctx->ppid, 0, 
+                                                        ctx->streamno, 0, 0 );
+                                else
+                                        ret = sendit( ctx->common.sock, ctx->ppid, 
+                                                        ctx->streamno, 0, send_dst( ctx ), 
+                                                        addrlen, msg, ctx->chunk_size );
+                                if ( ret < 0 ) {
+                                        print_error("Send failed", errno);
+                                        break;
+                                }
+                                ret = 0;
+                        }
+                        elapsed[m] += time_now_ns() - start;
+                        sent[m] += j;
+                }
+        }
+        for ( m = 0; m < 2; m++ ) {
+                printf("%-14s: %8" PRIu64 " msgs in %8.3f ms, %8.1f ns/msg\n",
+                                names[m], sent[m], elapsed[m] / 1000000.0,
+                                sent[m] > 0 ? (double)elapsed[m] / sent[m] : 0.0 );
+        }
+        if ( sent[0] > 0 && sent[1] > 0 )
+                printf("sendit() changes the cost per message by %+.1f ns\n",
+                                (double)elapsed[1] / sent[1] - 
+                                (double)elapsed[0] / sent[0] );
+        payload_free( &ctx->payload );
+        return ret;
+}
+
 int main( int argc, char *argv[] )
 {
         struct client_ctx ctx;
-        struct sctp_event_subscribe event;
         int ret, domain;
 
         memset( &ctx, 0, sizeof( ctx));
 
         ctx.chunk_size = DEFAULT_CHUNK_SIZE;
         ctx.chunk_count = DEFAULT_COUNT;
+        ctx.burst = PACER_DEFAULT_BURST;
         ctx.streamno = DEFAULT_STREAM_NO;
         ctx.ppid = DEFAULT_PPID;
         ctx.common.sock = -1;
+        ctx.common.cpu = -1;
         strncpy( ctx.filename, DEFAULT_FILENAME, FILENAME_LEN );
 
         ret =  parse_args(argc, argv, &ctx );
@@ -430,33 +2345,38 @@ int main( int argc, char *argv[] )
                 ((struct sockaddr_in6 *)&(ctx.host))->sin6_port = htons(ctx.port);
                 domain = PF_INET6;
         }
-        if (common_init(&ctx.common) != 0)
-                goto out;
-
-        if (ctx.lport != 0 ) {
-                if (bind_to_local_port(domain, ctx.common.sock, ctx.lport) != 0 ) {
-                        close(ctx.common.sock);
-                        return EXIT_FAILURE;
-                }
+        common_start_output(&ctx.common);
+#ifdef HAVE_EPOLL
+        if (ctx.associations > 1) {
+                ret = do_client_multi( &ctx );
+                common_deinit(&ctx.common);
+                return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
-
-        if (is_flag(ctx.common.options, (VERBOSE_FLAG|ECHO_FLAG))) {
-                /* we need to subscribe to I/O events to be able to show them
-                 * from received data
-                 */
-                memset(&event, 0, sizeof(event));
-                event.sctp_data_io_event = 1;
-
-                if (setsockopt(ctx.common.sock, IPPROTO_SCTP, SCTP_EVENTS,
-                                        &event, sizeof(event)) != 0 ) {
-                        WARN("Unable to register for SCTP IO events: %s \n",
-                                        strerror(errno));
-                        /* not a fatal error, we just get the I/O info wrong */
-                }
+#endif /* HAVE_EPOLL */
+        if (ctx.compare) {
+                ret = do_interleave_compare(&ctx, domain);
+                common_deinit(&ctx.common);
+                return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (open_socket(&ctx, domain) != 0)
+                return EXIT_FAILURE;
+        if (ctx.send_bench) {
+                ret = do_send_bench(&ctx);
+                common_deinit(&ctx.common);
+                return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
         }
 
-        do_client( &ctx );
-out :
+        if (ctx.ctrl_rate > 0 && is_flag(ctx.common.options, ECHO_FLAG))
+                ctx.ctrl_lat = hist_create();
+#ifdef HAVE_URING
+        if (ctx.common.engine == ENGINE_URING) 
+                do_client_uring( &ctx );
+        else
+#endif /* HAVE_URING */
+                do_client( &ctx );
+        if (ctx.ctrl_lat != NULL)
+                hist_delete(ctx.ctrl_lat);
+
         common_deinit(&ctx.common);
         return EXIT_SUCCESS; /* XXX Error case */
 }
@@ -91,6 +91,45 @@ static void verbose_assoc_event( struct sctp_assoc_change *assoc_ch )
         }
 }
 
+/**
+ * Print information about SCTP_PEER_ADDR_CHANGE event.
+ *
+ * @param spc The event data.
+ */
+static void verbose_paddr_event( struct sctp_paddr_change *spc )
+{
+        struct sockaddr_storage ss;
+
+        /* the event structure is packed */
+        memcpy( &ss, &spc->spc_aaddr, sizeof(ss));
+        printf("##Peer address ");
+        print_ss( &ss );
+        printf(" of association %d ", spc->spc_assoc_id );
+        switch( spc->spc_state ) {
+                case SCTP_ADDR_AVAILABLE :
+                        printf("is available\n");
+                        break;
+                case SCTP_ADDR_UNREACHABLE :
+                        printf("is unreachable (Error 0x%.4x)\n", spc->spc_error);
+                        break;
+                case SCTP_ADDR_REMOVED :
+                        printf("was removed\n");
+                        break;
+                case SCTP_ADDR_ADDED :
+                        printf("was added\n");
+                        break;
+                case SCTP_ADDR_MADE_PRIM :
+                        printf("was made primary\n");
+                        break;
+                case SCTP_ADDR_CONFIRMED :
+                        printf("was confirmed\n");
+                        break;
+                default :
+                        printf("changed state to %d\n", spc->spc_state);
+                        break;
+        }
+}
+
 /**
  * Print verbose information about incoming SHUTDOWN_EVENT.
  * @param shut The event data.
@@ -163,6 +202,9 @@ int handle_event( uint8_t *data )
                 case SCTP_ASSOC_CHANGE :
                         verbose_assoc_event(&(not->sn_assoc_change));
                         break;
+                case SCTP_PEER_ADDR_CHANGE :
+                        verbose_paddr_event(&(not->sn_paddr_change));
+                        break;
                 case SCTP_SHUTDOWN_EVENT :
                         verbose_shutdown_event(&(not->sn_shutdown_event));
                         break;
@@ -36,7 +36,6 @@
 #include <errno.h>
 #include <string.h>
 
-#include <sys/select.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -48,6 +47,10 @@
 #include <unistd.h>
 #include <signal.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #define DBG_MODULE_NAME DBG_MODULE_SERVER
 
@@ -56,22 +59,70 @@
 #include "common.h"
 #include "sctp_events.h"
 #include "sctp_auth.h"
+#include "stats.h"
+#include "batch.h"
+#include "reasm.h"
+#include "histogram.h"
+#include "streams.h"
+#include "outlog.h"
+#ifdef HAVE_URING
+#include "uring.h"
+#endif /* HAVE_URING */
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 
 #define DEFAULT_PORT 2001
 #define DEFAULT_BACKLOG 2
+/**
+ * Backlog used when all connections are served from single epoll loop.
+ */
+#define EPOLL_BACKLOG SOMAXCONN
+/**
+ * Maximum number of events to handle on one epoll_wait() round.
+ */
+#define EPOLL_MAX_EVENTS 64
+/**
+ * Maximum number of messages read from one socket before moving to next
+ * ready socket.
+ */
+#define EPOLL_RECV_BUDGET 8
 
 #define RECVBUF_SIZE 1024
 
 /**
- * Number of milliseconds to wait on select() before checking if user has
- * requested stop.
+ * Size of the receive buffer in sink mode, unless set by user.
+ */
+#define SINK_RECVBUF_SIZE 262144
+
+/**
+ * Maximum number of messages drained in sink mode before checking the
+ * stop request and statistics.
+ */
+#define SINK_RECV_BUDGET 256
+
+/**
+ * Number of milliseconds to wait before checking if user has requested
+ * stop, used only if the stop eventfd could not be created.
  */
 #define ACCEPT_TIMEOUT_MS 100
 
 /**
  * Indication that user has requested close
  */
-static int close_req = 0;
+static volatile sig_atomic_t close_req = 0;
+
+/**
+ * Eventfd signalled when user requests close, -1 if not available. All
+ * the waits include this so that no periodic wakeups are needed.
+ */
+static int stop_fd = -1;
+
+/**
+ * Eventfd signalled when a worker process exits, -1 if not available.
+ */
+static int child_fd = -1;
 
 /**
  * The main context.
@@ -79,8 +130,26 @@ static int close_req = 0;
 struct server_ctx {
         uint16_t port; /**< Port we are listening on */
         uint8_t *recvbuf; /**< Buffer where data is received */
-        uint16_t recvbuf_size; /**< Number of bytes of data on buffer */
+        uint32_t recvbuf_size; /**< Number of bytes of data on buffer */
+        int use_epoll; /**< Serve all connections from single epoll loop */
+        int sink; /**< Only count the received data */
+        uint16_t workers; /**< Number of workers, 0 if no workers are used */
+        int worker_procs; /**< Run the workers as processes instead of threads */
+        uint16_t peel_workers; /**< Number of workers for the peeled off associations, 0 if not used */
+        struct peel_pool *pool; /**< Workers to hand the new associations to, if any */
+        int peeled; /**< 1 if serving peeled off sockets */
+        int assoc_closed; /**< Set when the association of the peeled off socket ends */
         struct partial_store partial; /**< partial datagrams collected here */
+        struct reasm_table reasm; /**< Partial messages per association */
+        struct tput_stats stats; /**< Statistics for received data */
+        int stream_stats; /**< 1 if the statistics are reported per stream */
+        struct stream_table streams; /**< Per-stream statistics, if reported */
+        char label[20]; /**< Label for the statistics reports */
+        struct mmsg_batch rx; /**< Batch for received messages */
+        struct mmsg_batch tx; /**< Batch for echoed messages */
+#ifdef HAVE_URING
+        struct uring_engine *uring; /**< io_uring engine, if used */
+#endif /* HAVE_URING */
         struct common_context common; /**< Context common for client & server*/
 };
 
@@ -103,165 +172,1171 @@ int bind_and_listen( struct server_ctx *ctx )
         ss.sin6_port = htons(ctx->port);
 
         memcpy( &ss.sin6_addr, &in6addr_any, sizeof(struct in6_addr));
-        if ( bind(ctx->common.sock,
+        if ( ctx->workers > 0 ) {
+#ifdef SO_REUSEPORT
+                int on = 1;
+
+                if ( setsockopt( ctx->common.sock, SOL_SOCKET, SO_REUSEPORT,
+                                        &on, sizeof(on)) < 0 ) {
+                        print_error( "Unable to set SO_REUSEPORT", errno );
+                        return -1;
+                }
+#else
+                fprintf(stderr, "SO_REUSEPORT is not supported\n");
+                return -1;
+#endif /* SO_REUSEPORT */
+        }
+        if ( ctx->common.laddrs.count > 0 ) {
+                if ( common_bindx( ctx->common.sock, &ctx->common.laddrs, 
+                                        ctx->port ) < 0 )
+                        return -1;
+        } else if ( bind(ctx->common.sock,
                   (struct sockaddr *)&ss,
                    sizeof( struct sockaddr_in6)) < 0 ) {
                 print_error( "Unable to bind()", errno );
                 return -1;
         }
 
-        if ( listen( ctx->common.sock, DEFAULT_BACKLOG ) < 0 ) {
+        if ( listen( ctx->common.sock, 
+                     ctx->use_epoll ? EPOLL_BACKLOG : DEFAULT_BACKLOG ) < 0 ) {
                 print_error(" Unable to listen()", errno );
                 return -1;
         }
 
-        return 0;
+        return 0;
+}
+
+
+/**
+ * Wait until the socket is readable, user requests stop or the timeout
+ * expires.
+ *
+ * @param fd The socket to wait for.
+ * @param timeout_ms Maximum time to wait in milliseconds, -1 for no
+ * timeout.
+ * @return 1 if the socket is readable, 0 if stop was requested or timeout
+ * expired, -1 on error.
+ */
+static int wait_readable( int fd, int timeout_ms )
+{
+        struct pollfd pfd[2];
+        int ret;
+
+        if ( stop_fd < 0 && (timeout_ms < 0 || timeout_ms > ACCEPT_TIMEOUT_MS))
+                timeout_ms = ACCEPT_TIMEOUT_MS;
+
+        pfd[0].fd = fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = stop_fd; /* ignored by poll() if -1 */
+        pfd[1].events = POLLIN;
+        ret = poll( pfd, 2, timeout_ms );
+        if ( ret <= 0 )
+                return ret;
+
+        return pfd[0].revents != 0 ? 1 : 0;
+}
+
+/**
+ * Get the maximum time to wait for data, so that the throughput reports
+ * are printed also when there is no traffic.
+ *
+ * @param ctx Pointer to main context.
+ * @return The time in milliseconds, -1 if there is no need to wake up.
+ */
+static int idle_timeout( struct server_ctx *ctx )
+{
+        if ( !is_flag( ctx->common.options, REPORT_FLAG ))
+                return -1;
+
+        return ctx->common.interval_ns / (NSEC_PER_SEC / 1000);
+}
+
+/**
+ * Receive message from socket, waiting for one only if there is no
+ * message pending.
+ *
+ * Compared to recv_wait() this saves a system call per message when the
+ * data is flowing.
+ *
+ * @param ctx Pointer to main context.
+ * @param fd The socket to read.
+ * @param peer Pointer where the address of the remote peer is saved.
+ * @param peerlen Length of the address buffer, set to the length of the
+ * address.
+ * @param info Pointer where the sndrcvinfo is saved.
+ * @param flags Pointer where the flags are saved.
+ * @return Number of bytes received, 0 if no data was received before 
+ * stop request or timeout, -1 on error, -2 if the remote end closed the
+ * connection.
+ */
+static int server_recv( struct server_ctx *ctx, int fd, 
+                struct sockaddr *peer, socklen_t *peerlen, 
+                struct sctp_sndrcvinfo *info, int *flags )
+{
+        socklen_t len = *peerlen;
+        int ret;
+
+        *flags = MSG_DONTWAIT;
+        ret = sctp_recvmsg( fd, ctx->recvbuf, ctx->recvbuf_size, 
+                        peer, peerlen, info, flags );
+        if ( ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                /* busy polling, let the caller spin */
+                if ( is_flag( ctx->common.options, BUSY_POLL_FLAG )) 
+                        return 0;
+                ret = wait_readable( fd, idle_timeout( ctx ));
+                if ( ret <= 0 ) 
+                        return ret;
+
+                *peerlen = len;
+                *flags = MSG_DONTWAIT;
+                ret = sctp_recvmsg( fd, ctx->recvbuf, ctx->recvbuf_size, 
+                                peer, peerlen, info, flags );
+                if ( ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return 0;
+        }
+        if ( ret < 0 && errno == ECONNRESET ) 
+                return -2;
+        if ( ret == 0 ) 
+                return -2;
+
+        return ret;
+}
+
+/**
+ * Wait for incoming connection.
+ *
+ * Returns either when a connection from remote server accepted or if stop_req
+ * is set to 1.
+ *
+ * @param ctx Pointer to main context.
+ * @param remote_ss Address of the remote host is saved here.
+ * @param addrlen Pointer to variable where lenght of remote host data is saved.
+ * @return -1 on error, the fd for accepted connection on success.
+ */
+int do_accept( struct server_ctx *ctx, struct sockaddr_storage *remote_ss, 
+                socklen_t *addrlen )
+{
+        int cli_fd, ret;
+
+        while( ! close_req ) {
+                ret = wait_readable( ctx->common.sock, -1 );
+                if ( ret < 0 ) {
+                        if ( errno == EINTR ) 
+                                continue;
+
+                        print_error( "Error in poll()", errno);
+                        return -1;
+                } else if ( ret == 0 ) {
+                        continue;
+                }
+                TRACE("Going to accept()\n");
+                cli_fd = accept( ctx->common.sock, (struct sockaddr *)remote_ss, 
+                                addrlen );
+                if ( cli_fd < 0 ) {
+                        if ( errno == EINTR ) 
+                                continue; /* likely we are closing */
+
+                        print_error( "Error in accept()", errno);
+#ifdef IGNORE_ACCEPT_ERROR
+                        continue;
+#else
+                        return -1;
+#endif /* IGNORE_ACCEPT_ERROR */
+                }
+                return cli_fd;
+        }
+        return 0;
+}
+/* do_server() return values */
+
+#define SERVER_USER_CLOSE 0
+#define SERVER_ERROR -1
+#define SERVER_REMOTE_CLOSED -2
+
+/**
+ * Send the echo for received message.
+ *
+ * When batching is enabled, the message is queued to the batch of echoes
+ * which is sent once all the received messages have been handled.
+ *
+ * @param ctx Pointer to main context.
+ * @param fd The socket to send the echo to.
+ * @param info The sndrcvinfo of the received message.
+ * @param peer_ss Address of the remote peer.
+ * @param peerlen Length of the remote peer address.
+ * @param data The data to echo.
+ * @param len Number of bytes to echo.
+ * @return -1 on error, 0 on success.
+ */
+static int echo_data( struct server_ctx *ctx, int fd, 
+                struct sctp_sndrcvinfo *info, 
+                struct sockaddr_storage *peer_ss, socklen_t peerlen,
+                uint8_t *data, int len )
+{
+        struct sockaddr *dst = NULL;
+
+        /* the address is needed only on one-to-many socket */
+        if ( is_flag( ctx->common.options, SEQ_FLAG ))
+                dst = (struct sockaddr *)peer_ss;
+#ifdef HAVE_URING
+        /* submitted with the next wait for completions */
+        if ( ctx->uring != NULL && uring_send( ctx->uring, fd, dst, peerlen,
+                                data, len, info->sinfo_ppid, 
+                                info->sinfo_stream, 0 ) == 0 )
+                return 0;
+#endif /* HAVE_URING */
+        if ( ctx->tx.size > 0 ) {
+                if ( BATCH_FULL( &ctx->tx ) && batch_flush( fd, &ctx->tx ) < 0 )
+                        return -1;
+                if ( batch_add( &ctx->tx, (struct sockaddr *)peer_ss, peerlen,
+                                data, len, info->sinfo_ppid, 
+                                info->sinfo_stream, 0 ) == 0 )
+                        return 0;
+
+                /* too large for the batch, keep the order */
+                if ( ctx->tx.count > 0 && batch_flush( fd, &ctx->tx ) < 0 )
+                        return -1;
+        }
+        return sendit( fd, info->sinfo_ppid, info->sinfo_stream, 0,
+                        dst, peerlen, data, len );
+}
+
+/**
+ * Print the statistics reports which are due.
+ *
+ * @param ctx Pointer to main context.
+ */
+static void server_tick( struct server_ctx *ctx )
+{
+        stats_tick( &ctx->stats, ctx->label );
+        if ( ctx->streams.streams != NULL )
+                stream_stats_tick( &ctx->streams, ctx->label );
+}
+
+#ifdef HAVE_EPOLL
+/**
+ * Worker serving the associations peeled off from the one-to-many socket.
+ */
+struct peel_worker {
+        int id; /**< Number of the worker */
+        pthread_t thread; /**< Thread running the worker */
+        int pipe[2]; /**< Pipe the peeled off sockets are passed through */
+        uint32_t load; /**< Number of associations served, accessed atomically */
+        struct server_ctx ctx; /**< Context for the worker */
+};
+
+/**
+ * Pool of workers for the peeled off associations.
+ */
+struct peel_pool {
+        struct peel_worker *workers; /**< The workers */
+        uint16_t count; /**< Number of workers started */
+        uint64_t peeled; /**< Number of associations peeled off */
+};
+
+/**
+ * Peel off the new association to its own socket and hand it to the 
+ * worker with least associations.
+ *
+ * If the association can not be peeled off, it stays on the one-to-many
+ * socket and is served from there.
+ *
+ * @param pool The workers.
+ * @param sock The one-to-many socket.
+ * @param assoc_id The new association.
+ */
+static void peel_dispatch( struct peel_pool *pool, int sock, 
+                sctp_assoc_t assoc_id )
+{
+        struct peel_worker *w = &pool->workers[0];
+        uint16_t i;
+        int fd;
+
+        for ( i = 1; i < pool->count; i++ ) {
+                if ( __atomic_load_n( &pool->workers[i].load, __ATOMIC_RELAXED ) <
+                                __atomic_load_n( &w->load, __ATOMIC_RELAXED ))
+                        w = &pool->workers[i];
+        }
+        fd = sctp_peeloff( sock, assoc_id );
+        if ( fd < 0 ) {
+                print_error("Unable to peel off association", errno);
+                return;
+        }
+        __atomic_add_fetch( &w->load, 1, __ATOMIC_RELAXED );
+        if ( write( w->pipe[1], &fd, sizeof(fd)) != sizeof(fd)) {
+                print_error("Unable to pass association to worker", errno);
+                __atomic_sub_fetch( &w->load, 1, __ATOMIC_RELAXED );
+                close( fd );
+                return;
+        }
+        pool->peeled++;
+        DBG("Association %u peeled off to worker %d\n", 
+                        (unsigned int)assoc_id, w->id );
+}
+#endif /* HAVE_EPOLL */
+
+/**
+ * Handle notification received from the remote peer.
+ *
+ * The messages still under reassembly are dropped when their association
+ * goes away. With the peel off workers, new associations are handed to
+ * them. The peeled off sockets do not indicate the end of the association
+ * by returning 0 from recv, so the end is flagged on the context. The
+ * notification is printed only in verbose mode, on 
+ * SOCK_SEQPACKET socket the events are subscribed also otherwise.
+ *
+ * @param ctx Pointer to main context.
+ * @param data The notification.
+ */
+static void handle_notification( struct server_ctx *ctx, uint8_t *data )
+{
+        union sctp_notification *not = (union sctp_notification *)data;
+
+        if ( ctx->reasm.entries != NULL && 
+                        not->sn_header.sn_type == SCTP_ASSOC_CHANGE &&
+                        (not->sn_assoc_change.sac_state == SCTP_COMM_LOST ||
+                         not->sn_assoc_change.sac_state == SCTP_SHUTDOWN_COMP))
+                reasm_drop_assoc( &ctx->reasm, 
+                                not->sn_assoc_change.sac_assoc_id );
+        if ( ctx->streams.streams != NULL && 
+                        not->sn_header.sn_type == SCTP_ASSOC_CHANGE &&
+                        (not->sn_assoc_change.sac_state == SCTP_COMM_LOST ||
+                         not->sn_assoc_change.sac_state == SCTP_SHUTDOWN_COMP))
+                stream_stats_drop_assoc( &ctx->streams, 
+                                not->sn_assoc_change.sac_assoc_id );
+
+        if ( is_flag( ctx->common.options, VERBOSE_FLAG ))
+                handle_event( data );
+#ifdef HAVE_EPOLL
+        if ( ctx->pool != NULL && 
+                        not->sn_header.sn_type == SCTP_ASSOC_CHANGE &&
+                        not->sn_assoc_change.sac_state == SCTP_COMM_UP )
+                peel_dispatch( ctx->pool, ctx->common.sock, 
+                                not->sn_assoc_change.sac_assoc_id );
+#endif /* HAVE_EPOLL */
+        if ( ctx->peeled && not->sn_header.sn_type == SCTP_ASSOC_CHANGE &&
+                        (not->sn_assoc_change.sac_state == SCTP_COMM_LOST ||
+                         not->sn_assoc_change.sac_state == SCTP_SHUTDOWN_COMP))
+                ctx->assoc_closed = 1;
+}
+
+/**
+ * Handle data received from the remote peer.
+ *
+ * Notifications are collected to the given partial store and passed to
+ * handle_notification(). If echo mode is on, complete messages are echoed
+ * back. The messages delivered in pieces are collected to the given
+ * partial store or, on SOCK_SEQPACKET socket, to the store for the
+ * association (and stream) on the reassembly table, as the partial
+ * messages of different associations may be interleaved.
+ *
+ * @param ctx Pointer to main context.
+ * @param fd The socket the data was received from.
+ * @param partial The partial store to collect the data into.
+ * @param buf The received data.
+ * @param len Number of bytes received to buf.
+ * @param flags The flags returned by sctp_recvmsg().
+ * @param peer_ss Address of the remote peer.
+ * @param peerlen Length of the remote peer address.
+ * @param info The sndrcvinfo returned by sctp_recvmsg().
+ */
+static void handle_data( struct server_ctx *ctx, int fd,
+                struct partial_store *partial, uint8_t *buf, int len, int flags,
+                struct sockaddr_storage *peer_ss, socklen_t peerlen,
+                struct sctp_sndrcvinfo *info )
+{
+        struct partial_store *store = NULL;
+        uint8_t *data = buf;
+        int data_len = len;
+
+        DBG("Received %d bytes \n", len );
+        if ( flags & MSG_NOTIFICATION ) {
+                TRACE("Received SCTP event\n");
+                partial_store_collect(partial, buf, len);
+                if ( flags & MSG_EOR ) {
+                        handle_notification( ctx, 
+                                        partial_store_dataptr(partial));
+                        partial_store_flush(partial);
+                } 
+                return;
+        }
+
+        /* 
+         * The data is needed only for echoing. If the message arrives
+         * whole, it is echoed straight from the receive buffer and the
+         * partial store is used only for fragmented deliveries.
+         */
+        if ( is_flag( ctx->common.options, ECHO_FLAG )) {
+                if ( ctx->reasm.entries != NULL ) 
+                        store = reasm_lookup( &ctx->reasm, 
+                                        info->sinfo_assoc_id, info->sinfo_stream );
+                else if ( partial_store_len( partial ) > 0 )
+                        store = partial;
+
+                if ( store == NULL && !(flags & MSG_EOR) ) 
+                        store = ctx->reasm.entries != NULL ?
+                                reasm_get( &ctx->reasm, info->sinfo_assoc_id, 
+                                                info->sinfo_stream ) : 
+                                partial;
+                if ( store != NULL ) {
+                        partial_store_collect( store, buf, len );
+                        data = partial_store_dataptr( store );
+                        data_len = partial_store_len( store );
+                }
+        }
+
+        stats_add( &ctx->stats, (flags & MSG_EOR) ? 1 : 0, len );
+        if ( ctx->streams.streams != NULL )
+                stream_stats_add( &ctx->streams, info->sinfo_assoc_id, 
+                                info->sinfo_stream, buf, len, 
+                                (flags & MSG_EOR) ? 1 : 0 );
+        if (!is_flag(ctx->common.options, REPORT_FLAG)) {
+                if (is_flag(ctx->common.options, VERBOSE_FLAG)) 
+                        print_input( peer_ss, len, flags, info);
+                else
+                        print_input( peer_ss, len, flags, NULL);
+        }
+
+        if (is_flag(ctx->common.options, XDUMP_FLAG))
+                        xdump_data( stdout, buf, len, "Received data" );
+
+        if ( !is_flag( ctx->common.options, ECHO_FLAG ) || !(flags & MSG_EOR) ) 
+                return;
+
+        if ( echo_data( ctx, fd, info, peer_ss, peerlen, data, data_len ) < 0) {
+                WARN("Error while echoing data!\n");
+        } else if (!is_flag(ctx->common.options, REPORT_FLAG)) {
+                if (is_flag(ctx->common.options, VERBOSE_FLAG)) 
+                        print_output_verbose(peer_ss, data_len,
+                                        info->sinfo_ppid, info->sinfo_stream);
+                else
+                        print_output( peer_ss, data_len );
+        }
+        if ( store == NULL )
+                return;
+        if ( ctx->reasm.entries != NULL )
+                reasm_done( &ctx->reasm, info->sinfo_assoc_id, 
+                                info->sinfo_stream );
+        else
+                partial_store_flush( store );
+}
+
+/**
+ * Server loop for sink mode.
+ *
+ * The data is received without peer address or control messages and only
+ * counted, nothing is printed or stored. The messages are drained with
+ * non-blocking reads, the socket is polled only once there is no more
+ * data.
+ *
+ * MSG_TRUNC is not used to discard the data, SCTP delivers the rest of
+ * the message on next read instead of dropping it. Large receive buffer
+ * is used instead.
+ *
+ * @param ctx Pointer to main context.
+ * @param fd The socket to the remote peer (in SOCK_STREAM mode) or the "server
+ * socket" in SOCK_SEQPKT mode.
+ * @return SERVER_USER_CLOSE if user requested stop, SERVER_ERROR if there
+ * was error when receiving data, SERVER_REMOTE_CLOSED if the remote end
+ * closed connection.
+ */
+static int do_server_sink( struct server_ctx *ctx, int fd )
+{
+        struct msghdr msg;
+        struct iovec iov;
+        ssize_t ret;
+        int i;
+
+        iov.iov_base = ctx->recvbuf;
+        iov.iov_len = ctx->recvbuf_size;
+        while( ! close_req ) {
+                for ( i = 0; i < SINK_RECV_BUDGET; i++ ) {
+                        memset( &msg, 0, sizeof(msg));
+                        msg.msg_iov = &iov;
+                        msg.msg_iovlen = 1;
+                        ret = recvmsg( fd, &msg, MSG_DONTWAIT );
+                        if ( ret < 0 ) {
+                                if ( errno == EAGAIN || errno == EWOULDBLOCK ||
+                                                errno == EINTR )
+                                        break;
+                                if ( errno == ECONNRESET ) 
+                                        ret = 0;
+                                else {
+                                        print_error("Unable to read data", errno);
+                                        return SERVER_ERROR;
+                                }
+                        }
+                        if ( ret == 0 ) {
+                                printf("Connection closed by remote host\n" );
+                                return SERVER_REMOTE_CLOSED;
+                        }
+                        if ( !(msg.msg_flags & MSG_NOTIFICATION))
+                                stats_add( &ctx->stats, 
+                                                (msg.msg_flags & MSG_EOR) ? 1 : 0, ret );
+                }
+                /* drained all, wait for more */
+                if ( i < SINK_RECV_BUDGET && 
+                                !is_flag( ctx->common.options, BUSY_POLL_FLAG ) &&
+                                wait_readable( fd, idle_timeout( ctx )) < 0 &&
+                                errno != EINTR ) {
+                        print_error("Error in poll()", errno);
+                        return SERVER_ERROR;
+                }
+                server_tick( ctx );
+        }
+        return SERVER_USER_CLOSE;
+}
+
+#ifdef HAVE_URING
+/**
+ * Server loop using the io_uring engine.
+ *
+ * The messages are received with multishot receive and the echoes are
+ * submitted together with the next wait for completions.
+ *
+ * @param ctx Pointer to main context.
+ * @param fd The socket to the remote peer (in SOCK_STREAM mode) or the "server
+ * socket" in SOCK_SEQPKT mode.
+ * @return SERVER_USER_CLOSE if user requested stop, SERVER_ERROR if there
+ * was error when receiving data, SERVER_REMOTE_CLOSED if the remote end
+ * closed connection.
+ */
+static int do_server_uring( struct server_ctx *ctx, int fd )
+{
+        struct uring_event ev;
+        uint64_t timeout_ns;
+        int ret = SERVER_USER_CLOSE, n;
+
+        if ( uring_recv_start( ctx->uring, fd ) < 0 ) {
+                print_error("Unable to start receiving", errno);
+                return SERVER_ERROR;
+        }
+        /* the stop eventfd is watched by the ring */
+        if ( stop_fd < 0 ) 
+                timeout_ns = ACCEPT_TIMEOUT_MS * (NSEC_PER_SEC / 1000);
+        else if ( is_flag( ctx->common.options, REPORT_FLAG ))
+                timeout_ns = ctx->common.interval_ns;
+        else 
+                timeout_ns = URING_WAIT_FOREVER;
+        while( ! close_req ) {
+                n = uring_next( ctx->uring, &ev, timeout_ns );
+                if ( n < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+
+                        print_error("Unable to wait for completions", errno);
+                        ret = SERVER_ERROR;
+                        break;
+                } else if ( n > 0 && ev.type == URING_EV_SEND ) {
+                        if ( ev.res < 0 ) {
+                                WARN("Error while echoing data!\n");
+                        }
+                } else if ( n > 0 ) {
+                        if ( ev.res == -ECONNRESET || ev.res == 0 ||
+                             (ev.len == 0 && !(ev.flags & MSG_NOTIFICATION))) {
+                                uring_done( ctx->uring, &ev );
+                                printf("Connection closed by remote host\n" );
+                                ret = SERVER_REMOTE_CLOSED;
+                                break;
+                        } else if ( ev.res < 0 ) {
+                                print_error("Unable to read data", -ev.res);
+                                ret = SERVER_ERROR;
+                                break;
+                        }
+                        handle_data( ctx, fd, &ctx->partial, ev.data, ev.len, 
+                                        ev.flags, &ev.peer, ev.peerlen, &ev.info );
+                        uring_done( ctx->uring, &ev );
+                }
+                server_tick( ctx );
+        }
+        uring_stop( ctx->uring );
+        return ret;
+}
+#endif /* HAVE_URING */
+
+/**
+ * Server loop. 
+ *
+ * Wait for incoming data from remote peer and if echo mode is on, echo it
+ * back.
+ * 
+ * @param ctx Pointer to main context.
+ * @param fd The socket to the remote peer (in SOCK_STREAM mode) or the "server
+ * socket" in SOCK_SEQPKT mode.
+ * @return SERVER_USER_CLOSE if user requested stop (ctrl+c was pressed),
+ * SERVER_ERROR if there was error when receiving data, SERVER_OK if the remote
+ * end closed connetion.
+ */
+int do_server( struct server_ctx *ctx, int fd ) 
+{
+        struct sockaddr_storage peer_ss;
+        socklen_t peerlen;
+        struct sctp_sndrcvinfo info;
+        int ret,flags;
+
+        if ( ctx->sink )
+                return do_server_sink( ctx, fd );
+#ifdef HAVE_URING
+        if ( ctx->uring != NULL )
+                return do_server_uring( ctx, fd );
+#endif /* HAVE_URING */
+        while( ! close_req ) {
+                memset( &peer_ss, 0, sizeof( peer_ss ));
+                memset( &info, 0, sizeof( info ));
+                peerlen = sizeof( struct sockaddr_in6);
+
+                ret = server_recv( ctx, fd, (struct sockaddr *)&peer_ss, 
+                                &peerlen, &info, &flags );
+                if ( ret == -1 ) {
+                        if ( errno == EINTR )
+                                continue;
+
+                        print_error("Unable to read data", errno);
+                        return SERVER_ERROR;
+                } else if ( ret == -2 )  {
+                        printf("Connection closed by remote host\n" );
+                        return SERVER_REMOTE_CLOSED;
+                } else if ( ret > 0 ) {
+                        handle_data(ctx, fd, &ctx->partial, ctx->recvbuf,
+                                        ret, flags, &peer_ss, peerlen, &info);
+                }
+                server_tick( ctx );
+        }
+        return SERVER_USER_CLOSE;
+}
+
+/**
+ * Server loop for batched I/O on SOCK_SEQPACKET socket.
+ *
+ * All the available messages (up to the batch size) are received with one
+ * recvmmsg() call and the echoes for them are sent with one sendmmsg()
+ * call.
+ *
+ * @param ctx Pointer to main context.
+ * @param fd The "server socket".
+ * @return SERVER_USER_CLOSE if user requested stop, SERVER_ERROR if there
+ * was error when receiving data.
+ */
+static int do_server_batch( struct server_ctx *ctx, int fd )
+{
+        struct sctp_sndrcvinfo info;
+        uint8_t *buf;
+        size_t len;
+        socklen_t peerlen;
+        int ret, i, flags;
+
+        while( ! close_req ) {
+                ret = batch_recv( fd, &ctx->rx );
+                if ( ret == 0 && 
+                                !is_flag( ctx->common.options, BUSY_POLL_FLAG )) {
+                        /* nothing pending, wait for more */
+                        ret = wait_readable( fd, idle_timeout( ctx ));
+                        if ( ret > 0 )
+                                ret = batch_recv( fd, &ctx->rx );
+                }
+                if ( ret < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+
+                        print_error("Unable to read data", errno);
+                        return SERVER_ERROR;
+                }
+                for ( i = 0; i < ret; i++ ) {
+                        buf = batch_data( &ctx->rx, i, &len, &flags, &peerlen );
+                        batch_rcvinfo( &ctx->rx, i, &info );
+                        handle_data( ctx, fd, &ctx->partial, buf, len, flags,
+                                        &ctx->rx.addrs[i], peerlen, &info );
+                }
+                if ( ctx->tx.count > 0 && batch_flush( fd, &ctx->tx ) < 0 ) {
+                        WARN("Error while echoing data!\n");
+                }
+
+                server_tick( ctx );
+        }
+        return SERVER_USER_CLOSE;
+}
+
+#ifdef HAVE_EPOLL
+/**
+ * State for each socket registered to the epoll loop.
+ */
+struct server_conn {
+        int fd; /**< The socket */
+        int listening; /**< 1 if new connections are accepted from fd */
+        struct partial_store partial; /**< partial datagrams for this socket */
+        struct server_conn *next; /**< Next connection on the set */
+        struct server_conn *prev; /**< Previous connection on the set */
+};
+
+/**
+ * The epoll instance and all the connections registered to it.
+ */
+struct conn_set {
+        int epfd; /**< The epoll instance */
+        struct server_conn *head; /**< List of registered connections */
+};
+
+/**
+ * Create new connection state and register it to the epoll set.
+ *
+ * @param set The connection set.
+ * @param fd The socket to register.
+ * @param listening 1 if the socket is SOCK_STREAM listening socket.
+ * @return Pointer to the new connection state, NULL on error.
+ */
+static struct server_conn *conn_add( struct conn_set *set, int fd,
+                int listening )
+{
+        struct server_conn *conn;
+        struct epoll_event ev;
+
+        conn = mem_zalloc( sizeof(*conn));
+        conn->fd = fd;
+        conn->listening = listening;
+        partial_store_init(&conn->partial);
+
+        memset( &ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if ( epoll_ctl( set->epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 ) {
+                print_error("Unable to add socket to epoll set", errno);
+                mem_free(conn);
+                return NULL;
+        }
+        conn->next = set->head;
+        if ( set->head != NULL )
+                set->head->prev = conn;
+        set->head = conn;
+
+        return conn;
+}
+
+/**
+ * Remove the connection from the epoll set and release its resources.
+ *
+ * @param set The connection set.
+ * @param conn The connection to remove.
+ * @param close_fd 1 if the socket should be closed.
+ */
+static void conn_remove( struct conn_set *set, struct server_conn *conn,
+                int close_fd )
+{
+        epoll_ctl( set->epfd, EPOLL_CTL_DEL, conn->fd, NULL );
+        if ( conn->prev != NULL )
+                conn->prev->next = conn->next;
+        else
+                set->head = conn->next;
+        if ( conn->next != NULL )
+                conn->next->prev = conn->prev;
+
+        if ( close_fd )
+                close( conn->fd );
+
+        partial_store_free(&conn->partial);
+        mem_free(conn);
+}
+
+/**
+ * Print the address of the newly connected peer.
+ * @param remote Address of the remote peer.
+ */
+static void print_connection( struct sockaddr_storage *remote )
+{
+        printf("Connection from ");
+        print_ss(remote);
+        printf("\n");
+}
+
+/**
+ * Accept new connection from the listening socket and add it to the epoll
+ * set.
+ *
+ * @param set The connection set.
+ * @param lconn The listening socket.
+ * @return -1 on fatal error, 0 otherwise.
+ */
+static int conn_accept( struct conn_set *set, struct server_conn *lconn )
+{
+        struct sockaddr_storage remote;
+        socklen_t addrlen;
+        int cli_fd;
+
+        memset( &remote, 0, sizeof(remote));
+        addrlen = sizeof(remote);
+
+        cli_fd = accept( lconn->fd, (struct sockaddr *)&remote, &addrlen );
+        if ( cli_fd < 0 ) {
+                if ( errno == EINTR || errno == EAGAIN || 
+                                errno == ECONNABORTED ) 
+                        return 0;
+
+                print_error( "Error in accept()", errno);
+#ifdef IGNORE_ACCEPT_ERROR
+                return 0;
+#else
+                return -1;
+#endif /* IGNORE_ACCEPT_ERROR */
+        }
+        print_connection(&remote);
+
+        if ( conn_add( set, cli_fd, 0 ) == NULL ) {
+                close( cli_fd );
+                return 0;
+        }
+        return 0;
+}
+
+/**
+ * Read the pending data from the connection. 
+ *
+ * At most EPOLL_RECV_BUDGET messages are read in one go so that a single
+ * busy peer can not starve the others.
+ *
+ * @param ctx Pointer to main context.
+ * @param conn The connection to read from.
+ * @return SERVER_ERROR on error, SERVER_REMOTE_CLOSED if the remote end
+ * closed the connection (or the association of peeled off socket ended),
+ * 0 otherwise.
+ */
+static int conn_serve( struct server_ctx *ctx, struct server_conn *conn )
+{
+        struct sockaddr_storage peer_ss;
+        socklen_t peerlen;
+        struct sctp_sndrcvinfo info;
+        int ret,flags,i;
+
+        for ( i = 0; i < EPOLL_RECV_BUDGET; i++ ) {
+                memset( &peer_ss, 0, sizeof( peer_ss ));
+                memset( &info, 0, sizeof( info ));
+                peerlen = sizeof( struct sockaddr_in6);
+                flags = MSG_DONTWAIT;
+
+                ret = sctp_recvmsg( conn->fd, ctx->recvbuf, ctx->recvbuf_size,
+                                (struct sockaddr *)&peer_ss, &peerlen,
+                                &info, &flags );
+                if ( ret < 0 ) {
+                        if ( errno == EAGAIN || errno == EWOULDBLOCK || 
+                                        errno == EINTR )
+                                return 0;
+                        if ( errno == ECONNRESET )
+                                return SERVER_REMOTE_CLOSED;
+
+                        print_error("Unable to read data", errno);
+                        return SERVER_ERROR;
+                } else if ( ret == 0 ) {
+                        return SERVER_REMOTE_CLOSED;
+                }
+                handle_data(ctx, conn->fd, &conn->partial, ctx->recvbuf,
+                                ret, flags, &peer_ss, peerlen, &info);
+                if ( ctx->assoc_closed ) {
+                        ctx->assoc_closed = 0;
+                        return SERVER_REMOTE_CLOSED;
+                }
+        }
+        return 0;
+}
+
+/**
+ * Server loop serving all the connections from single epoll set. 
+ *
+ * In SOCK_STREAM mode the listening socket and all the accepted connections
+ * are registered to the same epoll set, each connection has its own partial
+ * store. In SOCK_SEQPACKET mode the server socket is the only socket.
+ *
+ * @param ctx Pointer to main context.
+ * @return SERVER_USER_CLOSE if user requested stop, SERVER_ERROR on error.
+ */
+static int do_server_epoll( struct server_ctx *ctx )
+{
+        struct epoll_event events[EPOLL_MAX_EVENTS], ev;
+        struct server_conn *conn, *lconn;
+        struct conn_set set;
+        int n, i, timeout, ret = SERVER_USER_CLOSE;
+
+        set.head = NULL;
+        set.epfd = epoll_create1( 0 );
+        if ( set.epfd < 0 ) {
+                print_error("Unable to create epoll instance", errno);
+                return SERVER_ERROR;
+        }
+        lconn = conn_add( &set, ctx->common.sock,
+                        !is_flag( ctx->common.options, SEQ_FLAG ));
+        if ( lconn == NULL ) {
+                close( set.epfd );
+                return SERVER_ERROR;
+        }
+        /* the stop request is the event without connection */
+        memset( &ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if ( stop_fd < 0 || 
+                        epoll_ctl( set.epfd, EPOLL_CTL_ADD, stop_fd, &ev ) < 0 )
+                timeout = ACCEPT_TIMEOUT_MS;
+        else 
+                timeout = idle_timeout( ctx );
+        if ( is_flag( ctx->common.options, BUSY_POLL_FLAG ))
+                timeout = 0;
+
+        while ( ! close_req && ret == SERVER_USER_CLOSE ) {
+                n = epoll_wait( set.epfd, events, EPOLL_MAX_EVENTS, timeout );
+                if ( n < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+
+                        print_error("Error in epoll_wait()", errno);
+                        ret = SERVER_ERROR;
+                        break;
+                }
+                for ( i = 0; i < n && ret == SERVER_USER_CLOSE; i++ ) {
+                        conn = events[i].data.ptr;
+                        if ( conn == NULL )
+                                continue;
+                        if ( conn->listening ) {
+                                if ( conn_accept( &set, conn ) < 0 ) 
+                                        ret = SERVER_ERROR;
+                                continue;
+                        }
+                        switch ( conn_serve( ctx, conn ) ) {
+                                case SERVER_REMOTE_CLOSED :
+                                        printf("Connection closed by remote host\n" );
+                                        if ( conn != lconn ) 
+                                                conn_remove( &set, conn, 1 );
+                                        break;
+                                case SERVER_ERROR :
+                                        if ( conn == lconn ) 
+                                                ret = SERVER_ERROR;
+                                        else 
+                                                conn_remove( &set, conn, 1 );
+                                        break;
+                                default :
+                                        break;
+                        }
+                }
+                server_tick( ctx );
+        }
+        /* The listening socket is closed by common_deinit() */
+        while ( set.head != NULL ) 
+                conn_remove( &set, set.head, set.head != lconn );
+
+        close( set.epfd );
+        return ret;
+}
+
+/**
+ * Take the sockets handed to the worker to its epoll set.
+ *
+ * @param w The worker.
+ * @param set The epoll set of the worker.
+ */
+static void peel_receive( struct peel_worker *w, struct conn_set *set )
+{
+        int fd;
+
+        while ( read( w->pipe[0], &fd, sizeof(fd)) == sizeof(fd)) {
+                if ( conn_add( set, fd, 0 ) == NULL ) {
+                        close( fd );
+                        __atomic_sub_fetch( &w->load, 1, __ATOMIC_RELAXED );
+                }
+        }
+}
+
+/**
+ * Server loop of the worker for the peeled off associations. 
+ *
+ * Like do_server_epoll(), but the sockets come from the pipe instead of
+ * accept().
+ *
+ * @param w The worker.
+ * @return SERVER_USER_CLOSE if user requested stop, SERVER_ERROR on error.
+ */
+static int serve_peeled( struct peel_worker *w )
+{
+        struct epoll_event events[EPOLL_MAX_EVENTS], ev;
+        struct server_ctx *ctx = &w->ctx;
+        struct server_conn *conn, *pconn;
+        struct conn_set set;
+        int n = 0, i, timeout, ret;
+
+        set.head = NULL;
+        set.epfd = epoll_create1( 0 );
+        if ( set.epfd < 0 ) {
+                print_error("Unable to create epoll instance", errno);
+                return SERVER_ERROR;
+        }
+        pconn = conn_add( &set, w->pipe[0], 0 );
+        if ( pconn == NULL ) {
+                close( set.epfd );
+                return SERVER_ERROR;
+        }
+        memset( &ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if ( stop_fd < 0 || 
+                        epoll_ctl( set.epfd, EPOLL_CTL_ADD, stop_fd, &ev ) < 0 )
+                timeout = ACCEPT_TIMEOUT_MS;
+        else 
+                timeout = idle_timeout( ctx );
+        if ( is_flag( ctx->common.options, BUSY_POLL_FLAG ))
+                timeout = 0;
+
+        while ( ! close_req ) {
+                n = epoll_wait( set.epfd, events, EPOLL_MAX_EVENTS, timeout );
+                if ( n < 0 ) {
+                        if ( errno == EINTR )
+                                continue;
+
+                        print_error("Error in epoll_wait()", errno);
+                        break;
+                }
+                for ( i = 0; i < n; i++ ) {
+                        conn = events[i].data.ptr;
+                        if ( conn == NULL )
+                                continue;
+                        if ( conn == pconn ) {
+                                peel_receive( w, &set );
+                                continue;
+                        }
+                        ret = conn_serve( ctx, conn );
+                        if ( ret == SERVER_REMOTE_CLOSED || ret == SERVER_ERROR ) {
+                                if ( ret == SERVER_REMOTE_CLOSED )
+                                        printf("%sConnection closed by remote host\n",
+                                                        ctx->label );
+                                conn_remove( &set, conn, 1 );
+                                __atomic_sub_fetch( &w->load, 1, __ATOMIC_RELAXED );
+                        }
+                }
+                server_tick( ctx );
+        }
+        /* The pipe is closed by peel_pool_stop() */
+        while ( set.head != NULL ) 
+                conn_remove( &set, set.head, set.head != pconn );
+
+        close( set.epfd );
+        return n < 0 ? SERVER_ERROR : SERVER_USER_CLOSE;
 }
 
-
 /**
- * Wait for incoming connection.
- *
- * Returns either when a connection from remote server accepted or if stop_req
- * is set to 1.
+ * Main function for the worker of the peeled off associations.
  *
- * @param ctx Pointer to main context.
- * @param remote_ss Address of the remote host is saved here.
- * @param addrlen Pointer to variable where lenght of remote host data is saved.
- * @return -1 on error, the fd for accepted connection on success.
+ * @param arg Pointer to the struct peel_worker.
+ * @return NULL
  */
-int do_accept( struct server_ctx *ctx, struct sockaddr_storage *remote_ss, 
-                socklen_t *addrlen )
+static void *peel_worker_main( void *arg )
 {
-        int cli_fd = 0, ret = 0;
-        fd_set fds;
-        struct timeval tv;
-
-        while( ret == 0 ) {
-                if ( close_req )
-                        return 0;
+        struct peel_worker *w = (struct peel_worker *)arg;
 
-                FD_ZERO( &fds );
-                FD_SET( ctx->common.sock, &fds );
+        /* the thread accepting the associations is on the first CPU */
+        common_prepare_io( &w->ctx.common, w->id + 1 );
+        serve_peeled( w );
+        if ( is_flag( w->ctx.common.options, REPORT_FLAG ))
+                stats_final( &w->ctx.stats, w->ctx.label );
+        if ( w->ctx.streams.streams != NULL )
+                stream_stats_final( &w->ctx.streams, w->ctx.label );
 
-                memset( &tv, 0, sizeof(tv));
+        mem_free( w->ctx.recvbuf );
+        w->ctx.recvbuf = NULL;
+        reasm_free( &w->ctx.reasm );
+        stream_stats_free( &w->ctx.streams );
+        partial_store_pool_free();
+        return NULL;
+}
 
-                tv.tv_usec = ACCEPT_TIMEOUT_MS * 1000;
+/**
+ * Start the workers for the peeled off associations.
+ *
+ * Each worker gets a copy of the main context with its own receive
+ * buffer, reassembly table and statistics. The peeled off sockets are
+ * one-to-one sockets, so the echoes are sent without address.
+ *
+ * @param ctx Pointer to main context, prepared for the one-to-many socket.
+ * @return The pool, NULL if no worker could be started.
+ */
+static struct peel_pool *peel_pool_start( struct server_ctx *ctx )
+{
+        struct peel_pool *pool;
+        struct peel_worker *w;
+        int i;
 
-                ret = select( ctx->common.sock+1, &fds, NULL, NULL, &tv );
-                if ( ret > 0 && FD_ISSET( ctx->common.sock, &fds ) )  {
-                        TRACE("Going to accept()\n");
-                        cli_fd = accept( ctx->common.sock, (struct sockaddr *)remote_ss, 
-                                        addrlen );
-                        if ( cli_fd < 0 ) {
-                                if ( errno == EINTR ) 
-                                        continue; /* likely we are closing */
+        pool = mem_zalloc( sizeof(*pool));
+        pool->workers = mem_zalloc( ctx->peel_workers * sizeof(*pool->workers));
+        for ( i = 0; i < ctx->peel_workers; i++ ) {
+                w = &pool->workers[i];
+                w->id = i;
+                if ( pipe( w->pipe ) < 0 ) {
+                        print_error("Unable to create pipe for worker", errno);
+                        break;
+                }
+                fcntl( w->pipe[0], F_SETFL, fcntl( w->pipe[0], F_GETFL ) | O_NONBLOCK );
 
-                                print_error( "Error in accept()", errno);
-#ifdef IGNORE_ACCEPT_ERROR
-                                ret = 0;
-                                continue;
-#else
-                                return -1;
-#endif /* IGNORE_ACCEPT_ERROR */
-                        }
-                } else if ( ret < 0 ) {
-                        if ( errno == EINTR ) 
-                                continue;
+                memcpy( &w->ctx, ctx, sizeof(*ctx));
+                w->ctx.common.options = unset_flag( w->ctx.common.options, SEQ_FLAG );
+                w->ctx.common.sock = -1;
+                w->ctx.pool = NULL;
+                w->ctx.peeled = 1;
+                w->ctx.recvbuf = mem_alloc( ctx->recvbuf_size );
+                partial_store_init( &w->ctx.partial );
+                if ( ctx->reasm.entries != NULL )
+                        reasm_init( &w->ctx.reasm, ctx->reasm.by_stream );
+                stats_init( &w->ctx.stats, ctx->common.interval_ns );
+                if ( ctx->stream_stats )
+                        stream_stats_init( &w->ctx.streams, ctx->common.interval_ns );
+                snprintf( w->ctx.label, sizeof(w->ctx.label), "worker %d: ", i );
 
-                        print_error( "Error in select()", errno);
-                        return -1;
+                errno = pthread_create( &w->thread, NULL, peel_worker_main, w );
+                if ( errno != 0 ) {
+                        print_error("Unable to create worker thread", errno);
+                        mem_free( w->ctx.recvbuf );
+                        reasm_free( &w->ctx.reasm );
+                        stream_stats_free( &w->ctx.streams );
+                        close( w->pipe[0] );
+                        close( w->pipe[1] );
+                        break;
                 }
+                pool->count++;
         }
-        return cli_fd;
+        if ( pool->count == 0 ) {
+                mem_free( pool->workers );
+                mem_free( pool );
+                return NULL;
+        }
+        printf("Associations are peeled off to %d workers\n", pool->count );
+        return pool;
 }
-/* do_server() return values */
-
-#define SERVER_USER_CLOSE 0
-#define SERVER_ERROR -1
-#define SERVER_REMOTE_CLOSED -2
 
 /**
- * Server loop. 
+ * Wait for the workers of the peeled off associations to finish (user has
+ * requested stop) and release the pool.
  *
- * Wait for incoming data from remote peer and if echo mode is on, echo it
- * back.
- * 
- * @param ctx Pointer to main context.
- * @param fd The socket to the remote peer (in SOCK_STREAM mode) or the "server
- * socket" in SOCK_SEQPKT mode.
- * @return SERVER_USER_CLOSE if user requested stop (ctrl+c was pressed),
- * SERVER_ERROR if there was error when receiving data, SERVER_OK if the remote
- * end closed connetion.
+ * @param pool The pool.
  */
-int do_server( struct server_ctx *ctx, int fd ) 
+static void peel_pool_stop( struct peel_pool *pool )
 {
-        struct sockaddr_storage peer_ss;
-        socklen_t peerlen;
-        struct sctp_sndrcvinfo info;
-        int ret,flags;
-
-        while( ! close_req ) {
-                memset( &peer_ss, 0, sizeof( peer_ss ));
-                memset( &info, 0, sizeof( peer_ss ));
-                peerlen = sizeof( struct sockaddr_in6);
-                flags = 0;
+        int i;
 
-                ret = recv_wait( fd, ACCEPT_TIMEOUT_MS,
-                                ctx->recvbuf, ctx->recvbuf_size, 
-                                (struct sockaddr *)&peer_ss, &peerlen,
-                                &info, &flags );
-                if ( ret == -1 ) {
-                        if ( errno == EINTR )
-                                continue;
+        for ( i = 0; i < pool->count; i++ ) {
+                pthread_join( pool->workers[i].thread, NULL );
+                close( pool->workers[i].pipe[0] );
+                close( pool->workers[i].pipe[1] );
+        }
+        printf("%" PRIu64 " associations peeled off\n", pool->peeled );
+        mem_free( pool->workers );
+        mem_free( pool );
+}
+#endif /* HAVE_EPOLL */
 
-                        print_error("Unable to read data", errno);
-                        return SERVER_ERROR;
-                } else if ( ret == -2 )  {
-                        printf("Connection closed by remote host\n" );
-                        return SERVER_REMOTE_CLOSED;
-                } else if ( ret > 0 ) {
-                        DBG("Received %d bytes \n", ret );
-                        partial_store_collect(&ctx->partial, ctx->recvbuf, ret);
-
-                        if ( flags & MSG_NOTIFICATION ) {
-                                TRACE("Received SCTP event\n");
-                                if ( flags & MSG_EOR ) {
-                                        handle_event(partial_store_dataptr(&ctx->partial));
-                                        partial_store_flush(&ctx->partial);
-                                } 
-                                continue;
-                        }
+/**
+ * Make the eventfd readable. Safe to call from signal handler.
+ * @param fd The eventfd.
+ */
+static void notify_fd( int fd )
+{
+        uint64_t one = 1;
+        int saved = errno;
 
-                        if (is_flag(ctx->common.options, VERBOSE_FLAG)) 
-                                print_input( &peer_ss, ret, flags, &info);
-                        else
-                                print_input( &peer_ss, ret, flags, NULL);
-
-                        if (is_flag(ctx->common.options, XDUMP_FLAG))
-                                        xdump_data( stdout, ctx->recvbuf, ret, "Received data" );
-
-                        if ( is_flag( ctx->common.options, ECHO_FLAG ) && (flags & MSG_EOR) ) {
-                                if ( sendit( fd, info.sinfo_ppid, info.sinfo_stream,
-                                             (struct sockaddr *)&peer_ss, peerlen,
-                                              partial_store_dataptr( &ctx->partial),
-                                              partial_store_len( &ctx->partial) ) < 0) {
-                                        WARN("Error while echoing data!\n");
-                                } else {
-                                        if (is_flag(ctx->common.options, VERBOSE_FLAG)) 
-                                                print_output_verbose(&peer_ss,
-                                                     partial_store_len(&ctx->partial),
-                                                     info.sinfo_ppid, info.sinfo_stream);
-                                        else
-                                                print_output( &peer_ss,
-                                                     partial_store_len(&ctx->partial));
-                                }
-                        }
-                        if ( flags & MSG_EOR ) 
-                                partial_store_flush( &ctx->partial );
-                }
+        if ( write( fd, &one, sizeof(one)) < 0 ) {
+                /* the counter is already non-zero, the fd is readable */
         }
-        return SERVER_USER_CLOSE;
+        errno = saved;
 }
 
 /**
@@ -276,6 +1351,19 @@ void sighandler( int sig )
         }
 
         close_req = 1;
+        if ( stop_fd >= 0 ) 
+                notify_fd( stop_fd );
+}
+
+/**
+ * Signal handler for worker processes exiting.
+ * @param sig Signal received.
+ */
+static void sigchld_handler( int sig )
+{
+        (void)sig;
+        if ( child_fd >= 0 )
+                notify_fd( child_fd );
 }
 
 static void print_usage() 
@@ -286,13 +1374,28 @@ static void print_usage()
         printf("\t--port <port>  : listen on local port <p>, default %d \n", DEFAULT_PORT);
         printf("\t--buf <size>   : Size of rceive buffer is <size>, default is %d\n",
                       RECVBUF_SIZE);
+#ifdef HAVE_EPOLL
+        printf("\t--epoll        : Serve all connections concurrently from single epoll loop\n");
+#endif /* HAVE_EPOLL */
+        printf("\t--workers <n>  : Serve with <n> workers, each with own SO_REUSEPORT socket\n");
+        printf("\t--fork         : Run the workers as processes instead of threads\n");
+#ifdef HAVE_EPOLL
+        printf("\t--peeloff <n>  : With --seq, peel off each new association to its own\n");
+        printf("\t                 socket served by the least loaded of <n> worker threads\n");
+#endif /* HAVE_EPOLL */
+        printf("\t--sink         : Only count the received data, report throughput every\n");
+        printf("\t                 second (or --interval) and buffer size %d by default\n",
+                        SINK_RECVBUF_SIZE);
+        printf("\t--stream-stats : Report throughput and delivery latency per stream, the\n");
+        printf("\t                 latency of messages stamped by the client (same host only)\n");
         common_print_usage();
 }  
 
 static int parse_args( int argc, char **argv, struct server_ctx *ctx )
 {
-        int c, option_index, ret;
+        int c, option_index, ret, buf_set = 0;
         struct option long_options[] = {
+                COMMON_LONG_OPTIONS,
                 { "port", 1, 0, 'p' },
                 { "help", 0,0, 'H' },
                 { "buf", 1,0,'b' },
@@ -302,9 +1405,20 @@ static int parse_args( int argc, char **argv, struct server_ctx *ctx )
                 { "instreams", 1,0, 'I' },
                 { "outstreams", 1,0,'O' },
                 { "xdump", 0,0,'x' },
+                { "interval",1,0,'i' },
+                { "batch",1,0,'N' },
+                { "engine",1,0,'g' },
                 { "auth-key",1,0,'A'},
                 { "auth-hmac",1,0,'M'},
                 { "auth-chunk",1,0,'C'},
+#ifdef HAVE_EPOLL
+                { "epoll",0,0,'E'},
+                { "peeloff",1,0,'P'},
+#endif /* HAVE_EPOLL */
+                { "workers",1,0,'w'},
+                { "fork",0,0,'F'},
+                { "sink",0,0,'k'},
+                { "stream-stats",0,0,'T'},
 
 #ifdef DEBUG
                 { "debug",1,0,'D'},
@@ -314,7 +1428,7 @@ static int parse_args( int argc, char **argv, struct server_ctx *ctx )
 
         while (1) {
 
-                c = getopt_long( argc, argv, "p:b:HsxevI:O:D:A:M:C:",
+                c = getopt_long( argc, argv, "p:b:HsxevI:O:D:A:M:C:Ew:Fi:N:g:kTP:",
                                 long_options, &option_index );
                 if ( c == -1 )
                         break;
@@ -327,10 +1441,39 @@ static int parse_args( int argc, char **argv, struct server_ctx *ctx )
                                 }
                                 break;
                         case 'b' :
-                                if ( parse_uint16( optarg, &(ctx->recvbuf_size)) < 0 ) {
+                                if ( parse_uint32( optarg, &(ctx->recvbuf_size)) < 0 ||
+                                                ctx->recvbuf_size == 0 ) {
                                         fprintf(stderr, "Illegal recv buffer size given\n");
                                         return -1;
                                 }
+                                buf_set = 1;
+                                break;
+#ifdef HAVE_EPOLL
+                        case 'E' :
+                                ctx->use_epoll = 1;
+                                break;
+                        case 'P' :
+                                if ( parse_uint16( optarg, &(ctx->peel_workers)) < 0 ||
+                                                ctx->peel_workers == 0 ) {
+                                        fprintf(stderr, "Invalid number of peel off workers given\n");
+                                        return -1;
+                                }
+                                break;
+#endif /* HAVE_EPOLL */
+                        case 'w' :
+                                if ( parse_uint16( optarg, &(ctx->workers)) < 0 ) {
+                                        fprintf(stderr, "Invalid number of workers given\n");
+                                        return -1;
+                                }
+                                break;
+                        case 'F' :
+                                ctx->worker_procs = 1;
+                                break;
+                        case 'k' :
+                                ctx->sink = 1;
+                                break;
+                        case 'T' :
+                                ctx->stream_stats = 1;
                                 break;
                         case 'H' :
                                 print_usage();
@@ -347,18 +1490,363 @@ static int parse_args( int argc, char **argv, struct server_ctx *ctx )
                                 break;
                 }
         }
+        if ( ctx->common.batch > 0 && 
+                        (!is_flag( ctx->common.options, SEQ_FLAG ) || ctx->use_epoll)) {
+                fprintf(stderr, "Batching is supported only with --seq\n");
+                return -1;
+        }
+        if ( ctx->common.engine != ENGINE_CLASSIC && 
+                        (ctx->use_epoll || ctx->common.batch > 0)) {
+                fprintf(stderr, "The I/O engine can not be combined with --epoll or --batch\n");
+                return -1;
+        }
+        if ( is_flag( ctx->common.options, BUSY_POLL_FLAG ) && 
+                        ctx->common.engine != ENGINE_CLASSIC ) {
+                fprintf(stderr, "Busy poll can not be combined with --engine\n");
+                return -1;
+        }
+        if ( ctx->peel_workers > 0 && (!is_flag( ctx->common.options, SEQ_FLAG ) ||
+                                ctx->workers > 0 || ctx->use_epoll || ctx->sink ||
+                                ctx->common.batch > 0 || 
+                                ctx->common.engine != ENGINE_CLASSIC )) {
+                fprintf(stderr, "Peel off workers need --seq and can not be combined with --workers, --epoll, --sink, --batch or --engine\n");
+                return -1;
+        }
+        if ( ctx->sink && ctx->stream_stats ) {
+                fprintf(stderr, "Per-stream statistics are not available in sink mode\n");
+                return -1;
+        }
+        if ( ctx->sink ) {
+                if ( ctx->use_epoll || ctx->common.batch > 0 || 
+                                ctx->common.engine != ENGINE_CLASSIC ||
+                                is_flag( ctx->common.options, ECHO_FLAG )) {
+                        fprintf(stderr, "Sink mode can not be combined with --echo, --epoll, --batch or --engine\n");
+                        return -1;
+                }
+                if ( !buf_set )
+                        ctx->recvbuf_size = SINK_RECVBUF_SIZE;
+                if ( !is_flag( ctx->common.options, REPORT_FLAG )) {
+                        ctx->common.interval_ns = NSEC_PER_SEC;
+                        ctx->common.options = set_flag( ctx->common.options, 
+                                        REPORT_FLAG );
+                }
+        }
 
         return 1;
 }
 
+/**
+ * Run the server loop until user requests stop.
+ *
+ * @param ctx Pointer to main context, the socket should be listening.
+ * @return SERVER_ERROR if accepting connections failed, SERVER_USER_CLOSE
+ * otherwise.
+ */
+static int run_server( struct server_ctx *ctx )
+{
+        struct sockaddr_storage remote;
+        socklen_t addrlen;
+        int cli_fd, ret;
+
+#ifdef HAVE_EPOLL
+        if ( ctx->use_epoll ) {
+                do_server_epoll( ctx );
+                return SERVER_USER_CLOSE;
+        }
+#endif /* HAVE_EPOLL */
+        while ( !close_req ) {
+                if ( is_flag( ctx->common.options, SEQ_FLAG ) ) {
+                        if ( ctx->common.batch > 0 )
+                                ret = do_server_batch( ctx, ctx->common.sock );
+                        else
+                                ret = do_server( ctx, ctx->common.sock );
+                        if ( ret == SERVER_ERROR )
+                                break;
+                } else {
+                        memset( &remote, 0, sizeof(remote));
+                        addrlen = sizeof( struct sockaddr_in6);
+                        cli_fd = do_accept( ctx, &remote, &addrlen );
+                        if ( cli_fd < 0 ) {
+                                if ( errno == EINTR ) 
+                                        break;
+
+                                WARN( "Error in accept!\n");
+                                return SERVER_ERROR;
+                        } else if ( cli_fd == 0 ) {
+                                break;
+                        }
+                        printf("Connection from ");
+                        print_ss(&remote);
+                        printf("\n");
+                        if( do_server( ctx, cli_fd ) == SERVER_ERROR ) {
+                                close( cli_fd);
+                                break;
+                        }
+                        close( cli_fd );
+                }
+        }
+        return SERVER_USER_CLOSE;
+}
+
+/**
+ * Set up the reassembly of partial messages on SOCK_SEQPACKET socket.
+ *
+ * As the partial messages are collected per association, fragment
+ * interleave is enabled unless user has set the level. If the kernel
+ * interleaves also the streams (level 2), messages are keyed also by
+ * stream.
+ *
+ * @param ctx Pointer to main context, the socket should be created.
+ */
+static void reasm_prepare( struct server_ctx *ctx )
+{
+        socklen_t len;
+        int level = 1;
+
+        if ( !(ctx->common.tuning.set & TUNE_FRAG_INTERLEAVE) &&
+                        setsockopt( ctx->common.sock, IPPROTO_SCTP, 
+                                SCTP_FRAGMENT_INTERLEAVE, 
+                                &level, sizeof(level)) < 0 ) {
+                WARN("Unable to set SCTP_FRAGMENT_INTERLEAVE: %s\n",
+                                strerror(errno));
+        }
+        len = sizeof(level);
+        if ( getsockopt( ctx->common.sock, IPPROTO_SCTP, 
+                                SCTP_FRAGMENT_INTERLEAVE, &level, &len ) < 0 )
+                level = 0;
+
+        DBG("Fragment interleave level %d\n", level );
+        reasm_init( &ctx->reasm, level >= 2 );
+}
+
+/**
+ * Set the socket on the context to listen and allocate the receive
+ * buffer.
+ *
+ * @param ctx Pointer to main context, the socket should be created.
+ * @return -1 on error, 0 on success.
+ */
+static int server_prepare( struct server_ctx *ctx )
+{
+        if ( bind_and_listen( ctx ) < 0 ) {
+                fprintf(stderr, "Error while initializing the server\n" );
+                return -1;
+        }
+
+        /* 
+         * On one-to-many socket the association of the data and the
+         * association changes are needed for the reassembly.
+         */
+        if ( is_flag( ctx->common.options, VERBOSE_FLAG ) || ctx->stream_stats ||
+                        (is_flag( ctx->common.options, SEQ_FLAG ) && !ctx->sink))  
+                subscribe_to_events(ctx->common.sock); /* to err is not fatal */
+        if ( is_flag( ctx->common.options, SEQ_FLAG ) && !ctx->sink ) 
+                reasm_prepare( ctx );
+
+        TRACE("Allocating %d bytes for recv buffer \n", ctx->recvbuf_size );
+        ctx->recvbuf = mem_alloc( ctx->recvbuf_size * sizeof( uint8_t ));
+        if ( ctx->common.batch > 0 ) {
+                batch_init( &ctx->rx, ctx->common.batch, ctx->recvbuf_size );
+                batch_init( &ctx->tx, ctx->common.batch, ctx->recvbuf_size );
+        }
+#ifdef HAVE_URING
+        if ( ctx->common.engine == ENGINE_URING ) {
+                ctx->uring = uring_create( URING_DEFAULT_DEPTH, ctx->recvbuf_size );
+                if ( ctx->uring == NULL ) {
+                        print_error("Unable to create io_uring", errno);
+                        return -1;
+                }
+                if ( stop_fd >= 0 && uring_watch( ctx->uring, stop_fd ) < 0 ) {
+                        print_error("Unable to watch stop request", errno);
+                        return -1;
+                }
+        }
+#endif /* HAVE_URING */
+        stats_init( &ctx->stats, ctx->common.interval_ns );
+        if ( ctx->stream_stats )
+                stream_stats_init( &ctx->streams, ctx->common.interval_ns );
+        return 0;
+}
+
+/**
+ * Worker with its own listening socket and server context.
+ */
+struct server_worker {
+        int id; /**< Number of the worker */
+        pthread_t thread; /**< Thread running the worker (thread mode) */
+        pid_t pid; /**< Process running the worker (process mode) */
+        struct server_ctx ctx; /**< Context for the worker */
+};
+
+/**
+ * Wait until a worker process exits or user requests stop.
+ */
+static void wait_children()
+{
+        struct pollfd pfd[2];
+        uint64_t count;
+
+        pfd[0].fd = child_fd; /* ignored by poll() if -1 */
+        pfd[0].events = POLLIN;
+        pfd[1].fd = stop_fd;
+        pfd[1].events = POLLIN;
+        if ( poll( pfd, 2, child_fd < 0 || stop_fd < 0 ? 
+                                ACCEPT_TIMEOUT_MS : -1 ) > 0 && 
+                        pfd[0].revents != 0 ) {
+                if ( read( child_fd, &count, sizeof(count)) < 0 ) {
+                        /* already reset by earlier read */
+                }
+        }
+}
+
+/**
+ * Main function for the worker. 
+ *
+ * Create socket for the worker, bind it to the shared port and serve the
+ * associations the kernel hands to this socket.
+ *
+ * @param arg Pointer to the struct server_worker.
+ * @return NULL
+ */
+static void *worker_main( void *arg )
+{
+        struct server_worker *w = (struct server_worker *)arg;
+
+        w->ctx.common.sock = common_create_socket( &w->ctx.common );
+        if ( w->ctx.common.sock < 0 ) 
+                return NULL;
+
+        snprintf( w->ctx.label, sizeof(w->ctx.label), "worker %d: ", w->id );
+        if ( server_prepare( &w->ctx ) == 0 ) {
+                common_prepare_io( &w->ctx.common, w->id );
+                printf("Worker %d listening on port %d \n", w->id, w->ctx.port );
+                run_server( &w->ctx );
+                if ( is_flag( w->ctx.common.options, REPORT_FLAG ))
+                        stats_final( &w->ctx.stats, w->ctx.label );
+                if ( w->ctx.streams.streams != NULL )
+                        stream_stats_final( &w->ctx.streams, w->ctx.label );
+        }
+
+        if ( w->ctx.recvbuf != NULL )
+                mem_free( w->ctx.recvbuf );
+        batch_free( &w->ctx.rx );
+        batch_free( &w->ctx.tx );
+#ifdef HAVE_URING
+        uring_delete( w->ctx.uring );
+#endif /* HAVE_URING */
+        partial_store_free( &w->ctx.partial );
+        reasm_free( &w->ctx.reasm );
+        stream_stats_free( &w->ctx.streams );
+        partial_store_pool_free();
+        close( w->ctx.common.sock );
+        w->ctx.common.sock = -1;
+        return NULL;
+}
+
+/**
+ * Start the workers and wait until they all have finished.
+ *
+ * Each worker gets a copy of the main context with its own socket, receive
+ * buffer and partial store. The sockets are bound with SO_REUSEPORT so that
+ * the kernel distributes the incoming associations between the workers.
+ *
+ * @param ctx Pointer to main context.
+ * @return -1 if the workers could not be started, 0 otherwise.
+ */
+static int run_workers( struct server_ctx *ctx )
+{
+        struct server_worker *workers;
+        int i, started = 0, status, stopping = 0;
+        pid_t pid;
+
+        workers = mem_zalloc( ctx->workers * sizeof(*workers));
+        if ( ctx->worker_procs ) {
+                child_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+                if ( child_fd >= 0 && 
+                                signal( SIGCHLD, sigchld_handler ) == SIG_ERR ) {
+                        close( child_fd );
+                        child_fd = -1;
+                }
+        }
+        fflush(stdout);
+        for ( i = 0; i < ctx->workers; i++ ) {
+                workers[i].id = i;
+                memcpy( &workers[i].ctx, ctx, sizeof(*ctx));
+                workers[i].ctx.common.sock = -1;
+                /* the socket options are printed by the first worker */
+                workers[i].ctx.common.tuning_printed = i > 0;
+                workers[i].ctx.recvbuf = NULL;
+                partial_store_init( &workers[i].ctx.partial );
+
+                if ( ctx->worker_procs ) {
+                        pid = fork();
+                        if ( pid == 0 ) {
+                                /* own stop request for each process */
+                                close( stop_fd );
+                                stop_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+                                if ( child_fd >= 0 )
+                                        close( child_fd );
+                                child_fd = -1;
+                                /* the output thread is not forked */
+                                common_start_output( &ctx->common );
+                                worker_main( &workers[i] );
+                                outlog_stop();
+                                fflush(stdout);
+                                _exit( EXIT_SUCCESS );
+                        } else if ( pid < 0 ) {
+                                print_error("Unable to fork worker", errno);
+                                break;
+                        }
+                        workers[i].pid = pid;
+                } else {
+                        errno = pthread_create( &workers[i].thread, NULL, 
+                                        worker_main, &workers[i] );
+                        if ( errno != 0 ) {
+                                print_error("Unable to create worker thread", errno);
+                                break;
+                        }
+                }
+                started++;
+        }
+        if ( started < ctx->workers )
+                close_req = 1;
+
+        if ( ctx->worker_procs ) {
+                while ( started > 0 ) {
+                        if ( close_req && !stopping ) {
+                                /* Pass the stop request to the workers */
+                                for ( i = 0; i < ctx->workers; i++ ) {
+                                        if ( workers[i].pid > 0 )
+                                                kill( workers[i].pid, SIGTERM );
+                                }
+                                stopping = 1;
+                        }
+                        pid = waitpid( -1, &status, stopping ? 0 : WNOHANG );
+                        if ( pid > 0 ) {
+                                /* the pid may be reused once reaped */
+                                for ( i = 0; i < ctx->workers; i++ ) {
+                                        if ( workers[i].pid == pid )
+                                                workers[i].pid = 0;
+                                }
+                                started--;
+                        } else if ( pid == 0 ) {
+                                wait_children();
+                        } else if ( errno != EINTR ) {
+                                break;
+                        }
+                }
+        } else {
+                for ( i = 0; i < started; i++ ) 
+                        pthread_join( workers[i].thread, NULL );
+        }
+        mem_free( workers );
+        return started == ctx->workers ? 0 : -1;
+}
+
 int main( int argc, char *argv[] )
 {
-        struct sockaddr_storage myaddr,remote;
         struct server_ctx ctx;
-        int cli_fd, ret;
-        socklen_t addrlen;
-        char peer[INET6_ADDRSTRLEN];
-        void *ptr;
+        int ret;
 
         if ( signal( SIGTERM, sighandler ) == SIG_ERR ) {
                 fprintf(stderr, "Unable to set signal handler\n");
@@ -373,9 +1861,14 @@ int main( int argc, char *argv[] )
                 return EXIT_FAILURE;
         }
 
+        /* without the eventfd the waits just time out periodically */
+        stop_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
         memset( &ctx, 0, sizeof( ctx ));
         ctx.port = DEFAULT_PORT;
         ctx.recvbuf_size = RECVBUF_SIZE;
+        ctx.common.sock = -1;
+        ctx.common.cpu = -1;
 
         partial_store_init(&ctx.partial);
 
@@ -386,70 +1879,71 @@ int main( int argc, char *argv[] )
         } else if ( ret == 0 ) {
                 return EXIT_SUCCESS;
         }
-        
+        common_start_output(&ctx.common);
 
-        memset( &myaddr, 0, sizeof( myaddr));
-        myaddr.ss_family = AF_INET6;
+        if ( ctx.workers > 0 ) {
+                printf("Starting %d workers on port %d \n", ctx.workers, ctx.port );
+                ret = run_workers( &ctx );
+                common_deinit(&ctx.common);
+                return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
 
         if (common_init(&ctx.common) != 0)
                 goto out;
 
-
-        if ( bind_and_listen( &ctx ) < 0 ) {
-                fprintf(stderr, "Error while initializing the server\n" );
+        if ( server_prepare( &ctx ) < 0 ) {
                 close(ctx.common.sock);
                 return EXIT_FAILURE;
         }
-
-        if ( is_flag( ctx.common.options, VERBOSE_FLAG ))  
-                subscribe_to_events(ctx.common.sock); /* to err is not fatal */
-
-        memset( &remote, 0, sizeof(remote));
-        addrlen = sizeof( struct sockaddr_in6);
-
-        TRACE("Allocating %d bytes for recv buffer \n", ctx.recvbuf_size );
-        ctx.recvbuf = mem_alloc( ctx.recvbuf_size * sizeof( uint8_t ));
+        common_prepare_io( &ctx.common, 0 );
+#ifdef HAVE_EPOLL
+        if ( ctx.peel_workers > 0 ) {
+                ctx.pool = peel_pool_start( &ctx );
+                if ( ctx.pool == NULL ) {
+                        close( ctx.common.sock );
+                        return EXIT_FAILURE;
+                }
+        }
+#endif /* HAVE_EPOLL */
 
         printf("Listening on port %d \n", ctx.port );
-        while ( !close_req ) {
-                if ( is_flag( ctx.common.options, SEQ_FLAG ) ) {
-                        ret = do_server( &ctx, ctx.common.sock );
-                        if ( ret == SERVER_ERROR )
-                                break;
-                } else {
-                        cli_fd = do_accept( &ctx, &remote, &addrlen );
-                        if ( cli_fd < 0 ) {
-                                if ( errno == EINTR ) 
-                                        break;
-
-                                close( ctx.common.sock );
-                                mem_free( ctx.recvbuf);
-                                WARN( "Error in accept!\n");
-                                return EXIT_FAILURE;
-                        } else if ( cli_fd == 0 ) {
-                                break;
-                        }
-                        if ( remote.ss_family == AF_INET ) {
-                                ptr = &(((struct sockaddr_in *)&remote)->sin_addr);
-                        } else {
-                                ptr = &(((struct sockaddr_in6 *)&remote)->sin6_addr);
-                        }
-                        if ( inet_ntop(remote.ss_family, ptr, peer,
-                                                INET6_ADDRSTRLEN ) != NULL ) {
-                                printf("Connection from %s \n", peer );
-                        } else {
-                                printf("Connection from unknown\n");
-                        }
-                        if( do_server( &ctx, cli_fd ) == SERVER_ERROR ) {
-                                close( cli_fd);
-                                break;
-                        }
-                        close( cli_fd );
-                }
+        ret = run_server( &ctx );
+#ifdef HAVE_EPOLL
+        if ( ctx.pool != NULL ) {
+                /* the workers stop on the same request */
+                close_req = 1;
+                if ( stop_fd >= 0 )
+                        notify_fd( stop_fd );
+                peel_pool_stop( ctx.pool );
+                ctx.pool = NULL;
+        }
+#endif /* HAVE_EPOLL */
+        if ( ret == SERVER_ERROR ) {
+                close( ctx.common.sock );
+                mem_free( ctx.recvbuf);
+                batch_free( &ctx.rx );
+                batch_free( &ctx.tx );
+#ifdef HAVE_URING
+                uring_delete( ctx.uring );
+#endif /* HAVE_URING */
+                return EXIT_FAILURE;
         }
+        if ( is_flag( ctx.common.options, REPORT_FLAG ))
+                stats_final( &ctx.stats, ctx.label );
+        if ( ctx.streams.streams != NULL )
+                stream_stats_final( &ctx.streams, ctx.label );
 out :
         if (ctx.recvbuf != NULL)
                 mem_free( ctx.recvbuf);
+        batch_free( &ctx.rx );
+        batch_free( &ctx.tx );
+#ifdef HAVE_URING
+        uring_delete( ctx.uring );
+#endif /* HAVE_URING */
+        partial_store_free(&ctx.partial);
+        reasm_free(&ctx.reasm);
+        stream_stats_free(&ctx.streams);
+        partial_store_pool_free();
 
         common_deinit(&ctx.common);
         return EXIT_SUCCESS;
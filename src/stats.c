@@ -0,0 +1,146 @@
+/**
+ * @file stats.c - Throughput statistics.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_STATS
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "stats.h"
+
+/**
+ * Initialize the statistics and start the measurement.
+ *
+ * @param st Pointer to the statistics.
+ * @param interval_ns Interval for the reports, 0 if only final report
+ * should be printed.
+ */
+void stats_init( struct tput_stats *st, uint64_t interval_ns )
+{
+        memset( st, 0, sizeof(*st));
+        st->interval_ns = interval_ns;
+        st->start_ns = time_now_ns();
+        st->report_ns = st->start_ns;
+}
+
+/**
+ * Account messages to the statistics.
+ *
+ * @param st Pointer to the statistics.
+ * @param msgs Number of messages.
+ * @param bytes Number of bytes.
+ */
+void stats_add( struct tput_stats *st, uint64_t msgs, uint64_t bytes )
+{
+        st->msgs += msgs;
+        st->bytes += bytes;
+        st->int_msgs += msgs;
+        st->int_bytes += bytes;
+}
+
+/**
+ * Print one line of statistics.
+ *
+ * @param label Label to print in front of the statistics.
+ * @param from_ns Start of the period, relative to start of measurement.
+ * @param to_ns End of the period, relative to start of measurement.
+ * @param msgs Number of messages on the period.
+ * @param bytes Number of bytes on the period.
+ */
+void stats_print( const char *label, uint64_t from_ns, uint64_t to_ns,
+                uint64_t msgs, uint64_t bytes )
+{
+        double secs;
+
+        secs = (double)(to_ns - from_ns) / NSEC_PER_SEC;
+        if ( secs <= 0 )
+                secs = 1.0 / NSEC_PER_SEC;
+
+        printf("%s[%7.2f-%7.2f s] %10" PRIu64 " msgs %10.1f msgs/s "
+                        "%10.3f Mbit/s avg %7.1f bytes\n", label, 
+                        (double)from_ns / NSEC_PER_SEC, 
+                        (double)to_ns / NSEC_PER_SEC, msgs, msgs / secs,
+                        bytes * 8 / secs / 1000000,
+                        msgs > 0 ? (double)bytes / msgs : 0.0 );
+}
+
+/**
+ * Print the statistics for the interval if the interval has elapsed.
+ *
+ * @param st Pointer to the statistics.
+ * @param label Label to print in front of the statistics.
+ */
+void stats_tick( struct tput_stats *st, const char *label )
+{
+        uint64_t now;
+
+        if ( st->interval_ns == 0 )
+                return;
+
+        now = time_now_ns();
+        if ( now - st->report_ns < st->interval_ns )
+                return;
+
+        stats_print( label, st->report_ns - st->start_ns, now - st->start_ns,
+                        st->int_msgs, st->int_bytes );
+        st->int_msgs = 0;
+        st->int_bytes = 0;
+        st->report_ns = now;
+}
+
+/**
+ * Print the summary for the whole measurement.
+ *
+ * @param st Pointer to the statistics.
+ * @param label Label to print in front of the statistics.
+ */
+void stats_final( struct tput_stats *st, const char *label )
+{
+        uint64_t now = time_now_ns();
+
+        if ( st->interval_ns != 0 && st->int_msgs > 0 ) 
+                stats_print( label, st->report_ns - st->start_ns, 
+                                now - st->start_ns, st->int_msgs, 
+                                st->int_bytes );
+
+        printf("%s- - - - - - - - - - - - - - - - - - - - - - - - -\n", label);
+        stats_print( label, 0, now - st->start_ns, st->msgs, st->bytes );
+}
@@ -0,0 +1,56 @@
+/**
+ * @file stats.h - Throughput statistics.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/**
+ * Counters for throughput reporting.
+ */
+struct tput_stats {
+        uint64_t interval_ns; /**< Reporting interval, 0 for no reports */
+        uint64_t start_ns; /**< Time the measurement started */
+        uint64_t report_ns; /**< Time of the last report */
+        uint64_t msgs; /**< Total number of messages */
+        uint64_t bytes; /**< Total number of bytes */
+        uint64_t int_msgs; /**< Number of messages on current interval */
+        uint64_t int_bytes; /**< Number of bytes on current interval */
+};
+
+void stats_init( struct tput_stats *st, uint64_t interval_ns );
+void stats_add( struct tput_stats *st, uint64_t msgs, uint64_t bytes );
+void stats_tick( struct tput_stats *st, const char *label );
+void stats_final( struct tput_stats *st, const char *label );
+void stats_print( const char *label, uint64_t from_ns, uint64_t to_ns,
+                uint64_t msgs, uint64_t bytes );
+
+#endif /* _STATS_H_ */
@@ -0,0 +1,571 @@
+/**
+ * @file streams.c - Multi-stream sending and per-stream statistics
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_STREAMS
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "stats.h"
+#include "histogram.h"
+#include "streams.h"
+
+/**
+ * Number of stream statistics entries allocated at once, at least.
+ */
+#define STREAM_TABLE_MIN 16
+
+/**
+ * Parse comma separated list of numbers.
+ *
+ * @param arg The list.
+ * @param dst Array for the numbers, with room for STREAM_MAX_WEIGHTS.
+ * @param max The largest number allowed.
+ * @param allow_zero 1 if zero is allowed, 0 if the numbers must be positive.
+ * @return Number of numbers parsed, -1 if the list is invalid.
+ */
+static int parse_list( char *arg, uint32_t *dst, unsigned long max, 
+                int allow_zero )
+{
+        char *ptr = arg, *end;
+        unsigned long val;
+        int cnt = 0;
+
+        while ( *ptr != '\0' ) {
+                if ( cnt == STREAM_MAX_WEIGHTS )
+                        return -1;
+                errno = 0;
+                val = strtoul( ptr, &end, 10 );
+                if ( errno != 0 || end == ptr || val > max ||
+                                (val == 0 && !allow_zero) ||
+                                (*end != ',' && *end != '\0'))
+                        return -1;
+                dst[cnt++] = val;
+                ptr = *end == ',' ? end + 1 : end;
+        }
+        return cnt > 0 ? cnt : -1;
+}
+
+/**
+ * Parse the stream selection.
+ *
+ * The selection is either "rr", "hash" or comma separated list of weights
+ * for streams 0, 1, ...
+ *
+ * @param sel The stream selection.
+ * @param arg The selection given on command line.
+ * @return -1 if the selection is invalid, 0 on success.
+ */
+int stream_sel_parse( struct stream_sel *sel, char *arg )
+{
+        int cnt;
+
+        if ( strcmp( arg, "rr" ) == 0 ) {
+                sel->mode = STREAM_SEL_RR;
+                return 0;
+        } else if ( strcmp( arg, "hash" ) == 0 ) {
+                sel->mode = STREAM_SEL_HASH;
+                return 0;
+        }
+
+        cnt = parse_list( arg, sel->weights, UINT32_MAX, 0 );
+        if ( cnt < 0 )
+                return -1;
+
+        sel->mode = STREAM_SEL_WEIGHTS;
+        sel->weight_count = cnt;
+        return 0;
+}
+
+/**
+ * Parse the values for SCTP_STREAM_SCHEDULER_VALUE, comma separated list
+ * of values for streams 0, 1, ... The value is the priority (lower value
+ * is served first) for the priority scheduler and the weight for the
+ * weighted fair queueing.
+ *
+ * @param sel The stream selection.
+ * @param arg The values given on command line.
+ * @return -1 if the values are invalid, 0 on success.
+ */
+int stream_sel_parse_values( struct stream_sel *sel, char *arg )
+{
+        uint32_t vals[STREAM_MAX_WEIGHTS];
+        int cnt, i;
+
+        /* 0 is the highest priority */
+        cnt = parse_list( arg, vals, UINT16_MAX, 1 );
+        if ( cnt < 0 )
+                return -1;
+        for ( i = 0; i < cnt; i++ )
+                sel->values[i] = vals[i];
+        sel->value_count = cnt;
+        return 0;
+}
+
+/**
+ * Set the scheduler values of the streams for the association.
+ *
+ * @param sel The stream selection.
+ * @param sock The socket of the association.
+ * @param assoc_id The association.
+ */
+static void apply_values( struct stream_sel *sel, int sock, sctp_assoc_t assoc_id )
+{
+#ifdef SCTP_STREAM_SCHEDULER_VALUE
+        struct sctp_stream_value sv;
+        int i;
+
+        for ( i = 0; i < sel->value_count; i++ ) {
+                memset( &sv, 0, sizeof(sv));
+                sv.assoc_id = assoc_id;
+                sv.stream_id = i;
+                sv.stream_value = sel->values[i];
+                if ( setsockopt( sock, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER_VALUE,
+                                        &sv, sizeof(sv)) < 0 ) {
+                        fprintf(stderr, "Unable to set scheduler value for stream %d: %s\n",
+                                        i, strerror(errno));
+                        return;
+                }
+        }
+#else
+        (void)sock;
+        (void)assoc_id;
+        if ( sel->value_count > 0 )
+                fprintf(stderr, "Stream scheduler values are not supported\n");
+#endif /* SCTP_STREAM_SCHEDULER_VALUE */
+}
+
+/**
+ * Resolve the number of streams to use from the number of outbound
+ * streams negotiated for the association, and set the scheduler values of
+ * the streams.
+ *
+ * @param sel The stream selection.
+ * @param sock The socket of the association. On one-to-many socket the
+ * first association is used.
+ * @return -1 if the association is not (yet) available, 0 on success.
+ */
+int stream_sel_resolve( struct stream_sel *sel, int sock )
+{
+        struct sctp_status status;
+        uint32_t idbuf[2];
+        struct sctp_assoc_ids *ids = (struct sctp_assoc_ids *)idbuf;
+        socklen_t len;
+        int i;
+
+        memset( &status, 0, sizeof(status));
+        len = sizeof(status);
+        if ( getsockopt( sock, IPPROTO_SCTP, SCTP_STATUS, &status, &len ) < 0 ) {
+                len = sizeof(idbuf);
+                if ( getsockopt( sock, IPPROTO_SCTP, SCTP_GET_ASSOC_ID_LIST, 
+                                        ids, &len ) < 0 || 
+                                ids->gaids_number_of_ids == 0 )
+                        return -1;
+
+                memset( &status, 0, sizeof(status));
+                status.sstat_assoc_id = ids->gaids_assoc_id[0];
+                len = sizeof(status);
+                if ( getsockopt( sock, IPPROTO_SCTP, SCTP_STATUS, 
+                                        &status, &len ) < 0 ) 
+                        return -1;
+        }
+
+        if ( status.sstat_outstrms <= sel->first ) {
+                printf("Only %u streams negotiated with the peer, using stream 0\n",
+                                status.sstat_outstrms );
+                sel->first = 0;
+        }
+        sel->count = sel->requested;
+        if ( status.sstat_outstrms - sel->first < sel->count ) {
+                printf("Requested %u streams, only %u negotiated with the peer\n", 
+                                sel->requested + sel->first, status.sstat_outstrms );
+                sel->count = status.sstat_outstrms - sel->first;
+        }
+        sel->assoc_id = status.sstat_assoc_id;
+        apply_values( sel, sock, status.sstat_assoc_id );
+        sel->weight_sum = 0;
+        if ( sel->mode == STREAM_SEL_WEIGHTS ) {
+                for ( i = 0; i < sel->count; i++ ) {
+                        sel->weight_sum += sel->weights[sel->first + i];
+                        sel->current[i] = 0;
+                }
+        }
+        DBG("Sending on %u streams\n", sel->count );
+        return 0;
+}
+
+/**
+ * Choose the stream for the next message.
+ *
+ * @param sel The stream selection.
+ * @return The stream id, first if the number of streams is not resolved yet.
+ */
+uint16_t stream_sel_next( struct stream_sel *sel )
+{
+        uint32_t h;
+        int i, best;
+
+        if ( sel->count == 0 )
+                return sel->first;
+
+        h = sel->seq++;
+        switch ( sel->mode ) {
+                case STREAM_SEL_HASH :
+                        /* the finalizer of MurmurHash3 */
+                        h ^= h >> 16;
+                        h *= 0x85ebca6b;
+                        h ^= h >> 13;
+                        h *= 0xc2b2ae35;
+                        h ^= h >> 16;
+                        return sel->first + h % sel->count;
+                case STREAM_SEL_WEIGHTS :
+                        /* smooth weighted round robin */
+                        best = 0;
+                        for ( i = 0; i < sel->count; i++ ) {
+                                sel->current[i] += sel->weights[sel->first + i];
+                                if ( sel->current[i] > sel->current[best] )
+                                        best = i;
+                        }
+                        sel->current[best] -= sel->weight_sum;
+                        return sel->first + best;
+                default :
+                        return sel->first + h % sel->count;
+        }
+}
+
+/**
+ * Initialize the per-stream statistics.
+ *
+ * @param t The stream table.
+ * @param interval_ns Interval for the reports, 0 if only final report
+ * should be printed.
+ */
+void stream_stats_init( struct stream_table *t, uint64_t interval_ns )
+{
+        memset( t, 0, sizeof(*t));
+        t->interval_ns = interval_ns;
+        t->start_ns = time_now_ns();
+        t->report_ns = t->start_ns;
+        t->size = STREAM_TABLE_MIN;
+        t->streams = mem_zalloc( t->size * sizeof(*t->streams));
+}
+
+/**
+ * Release the per-stream statistics.
+ *
+ * @param t The stream table.
+ */
+void stream_stats_free( struct stream_table *t )
+{
+        uint32_t i;
+
+        if ( t->streams == NULL )
+                return;
+
+        for ( i = 0; i < t->size; i++ ) {
+                if ( t->streams[i].lat_interval != NULL ) {
+                        hist_delete( t->streams[i].lat_interval );
+                        hist_delete( t->streams[i].lat_total );
+                }
+        }
+        mem_free( t->streams );
+        t->streams = NULL;
+        t->size = 0;
+        if ( t->partials != NULL )
+                mem_free( t->partials );
+        t->partials = NULL;
+        t->partial_count = 0;
+        t->partial_size = 0;
+}
+
+/**
+ * Grow the stream table to contain given stream.
+ *
+ * @param t The stream table.
+ * @param stream The stream id.
+ */
+static void stream_table_grow( struct stream_table *t, uint16_t stream )
+{
+        uint32_t size = t->size * 2;
+
+        if ( size <= stream )
+                size = (uint32_t)stream + 1;
+        t->streams = mem_realloc( t->streams, size * sizeof(*t->streams));
+        memset( t->streams + t->size, 0, 
+                        (size - t->size) * sizeof(*t->streams));
+        t->size = size;
+}
+
+/**
+ * Find the message being delivered in parts on the association and
+ * stream.
+ *
+ * There are only few messages delivered in parts at the same time, so
+ * they are kept on an array.
+ *
+ * @param t The stream table.
+ * @param assoc_id The association.
+ * @param stream The stream.
+ * @return Index of the message, -1 if none.
+ */
+static int partial_find( struct stream_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream )
+{
+        uint32_t i;
+
+        for ( i = 0; i < t->partial_count; i++ ) {
+                if ( t->partials[i].assoc_id == assoc_id && 
+                                t->partials[i].stream == stream )
+                        return i;
+        }
+        return -1;
+}
+
+/**
+ * Remove the message being delivered in parts.
+ *
+ * @param t The stream table.
+ * @param i Index of the message.
+ */
+static void partial_remove( struct stream_table *t, uint32_t i )
+{
+        t->partials[i] = t->partials[--t->partial_count];
+}
+
+/**
+ * Remember the send time of the message being delivered in parts.
+ *
+ * @param t The stream table.
+ * @param assoc_id The association.
+ * @param stream The stream.
+ * @param send_ns Send time of the message, 0 if unknown.
+ */
+static void partial_add( struct stream_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream, uint64_t send_ns )
+{
+        struct stream_partial *p;
+
+        if ( t->partial_count == t->partial_size ) {
+                t->partial_size = t->partial_size > 0 ? t->partial_size * 2 : 
+                        STREAM_TABLE_MIN;
+                t->partials = mem_realloc( t->partials, 
+                                t->partial_size * sizeof(*t->partials));
+        }
+        p = &t->partials[t->partial_count++];
+        p->assoc_id = assoc_id;
+        p->stream = stream;
+        p->send_ns = send_ns;
+}
+
+/**
+ * Forget the messages being delivered in parts on the association, when
+ * the association ends.
+ *
+ * @param t The stream table.
+ * @param assoc_id The association.
+ */
+void stream_stats_drop_assoc( struct stream_table *t, sctp_assoc_t assoc_id )
+{
+        uint32_t i = 0;
+
+        while ( i < t->partial_count ) {
+                if ( t->partials[i].assoc_id == assoc_id )
+                        partial_remove( t, i );
+                else
+                        i++;
+        }
+}
+
+/**
+ * Account received data to the stream.
+ *
+ * If the message starts with the latency header, the delivery latency
+ * of the message is recorded once the message is complete. The latency
+ * is meaningful only if the clocks of the hosts are synchronized, as on
+ * the same host. The send time of the message delivered in parts is kept
+ * per association and stream, as the parts of the messages of different
+ * associations may be interleaved on the same stream.
+ *
+ * @param t The stream table.
+ * @param assoc_id The association the data was received on.
+ * @param stream The stream the data was received on.
+ * @param buf The received data.
+ * @param len Number of bytes received.
+ * @param eor 1 if the message was completed.
+ */
+void stream_stats_add( struct stream_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream, uint8_t *buf, int len, int eor )
+{
+        struct stream_stats *s;
+        struct latency_hdr hdr;
+        uint64_t now, send_ns = 0;
+        int i;
+
+        if ( stream >= t->size )
+                stream_table_grow( t, stream );
+
+        s = &t->streams[stream];
+        if ( !s->seen ) {
+                /* report on the same periods as the totals */
+                s->tput.start_ns = t->start_ns;
+                s->seen = 1;
+        }
+        stats_add( &s->tput, eor ? 1 : 0, len );
+
+        i = t->partial_count > 0 ? partial_find( t, assoc_id, stream ) : -1;
+        if ( i >= 0 ) {
+                send_ns = t->partials[i].send_ns;
+                if ( eor )
+                        partial_remove( t, i );
+        } else {
+                if ( len >= (int)sizeof(hdr)) {
+                        memcpy( &hdr, buf, sizeof(hdr));
+                        if ( hdr.magic == LATENCY_MAGIC )
+                                send_ns = hdr.send_ns;
+                }
+                if ( !eor )
+                        partial_add( t, assoc_id, stream, send_ns );
+        }
+        if ( !eor || send_ns == 0 )
+                return;
+
+        now = time_now_ns();
+        if ( now < send_ns )
+                return;
+        if ( s->lat_interval == NULL ) {
+                s->lat_interval = hist_create();
+                s->lat_total = hist_create();
+        }
+        hist_record( s->lat_interval, now - send_ns );
+}
+
+/**
+ * Print the statistics of the streams on the interval.
+ *
+ * @param t The stream table.
+ * @param label Label to print in front of the statistics.
+ * @param now End of the interval.
+ */
+static void stream_stats_report( struct stream_table *t, const char *label,
+                uint64_t now )
+{
+        struct stream_stats *s;
+        char slabel[80];
+        uint32_t i;
+
+        for ( i = 0; i < t->size; i++ ) {
+                s = &t->streams[i];
+                if ( !s->seen || s->tput.int_bytes == 0 )
+                        continue;
+
+                snprintf( slabel, sizeof(slabel), "%sstream %" PRIu32 " ", 
+                                label, i );
+                stats_print( slabel, t->report_ns - t->start_ns, 
+                                now - t->start_ns, s->tput.int_msgs, 
+                                s->tput.int_bytes );
+                s->tput.int_msgs = 0;
+                s->tput.int_bytes = 0;
+                if ( s->lat_interval != NULL && s->lat_interval->total > 0 ) {
+                        snprintf( slabel, sizeof(slabel), 
+                                        "%sstream %" PRIu32 " latency", label, i );
+                        hist_print( stdout, slabel, s->lat_interval );
+                        hist_merge( s->lat_total, s->lat_interval );
+                        hist_reset( s->lat_interval );
+                }
+        }
+        t->report_ns = now;
+}
+
+/**
+ * Print the statistics of the streams if the interval has elapsed.
+ *
+ * @param t The stream table.
+ * @param label Label to print in front of the statistics.
+ */
+void stream_stats_tick( struct stream_table *t, const char *label )
+{
+        uint64_t now;
+
+        if ( t->interval_ns == 0 )
+                return;
+
+        now = time_now_ns();
+        if ( now - t->report_ns < t->interval_ns )
+                return;
+
+        stream_stats_report( t, label, now );
+}
+
+/**
+ * Print the summary of the streams for the whole measurement.
+ *
+ * @param t The stream table.
+ * @param label Label to print in front of the statistics.
+ */
+void stream_stats_final( struct stream_table *t, const char *label )
+{
+        struct stream_stats *s;
+        uint64_t now = time_now_ns();
+        char slabel[80];
+        uint32_t i;
+
+        if ( t->interval_ns != 0 )
+                stream_stats_report( t, label, now );
+
+        printf("%s- - - - - - - - - - - - - - - - - - - - - - - - -\n", label);
+        for ( i = 0; i < t->size; i++ ) {
+                s = &t->streams[i];
+                if ( !s->seen )
+                        continue;
+
+                snprintf( slabel, sizeof(slabel), "%sstream %" PRIu32 " ", 
+                                label, i );
+                stats_print( slabel, 0, now - t->start_ns, s->tput.msgs, 
+                                s->tput.bytes );
+                if ( s->lat_interval != NULL ) {
+                        hist_merge( s->lat_total, s->lat_interval );
+                        hist_reset( s->lat_interval );
+                        snprintf( slabel, sizeof(slabel), 
+                                        "%sstream %" PRIu32 " latency", label, i );
+                        hist_print( stdout, slabel, s->lat_total );
+                }
+        }
+}
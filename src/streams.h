@@ -0,0 +1,125 @@
+/**
+ * @file streams.h - Multi-stream sending and per-stream statistics
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _STREAMS_H_
+#define _STREAMS_H_
+
+/**
+ * Streams are used in turn.
+ */
+#define STREAM_SEL_RR 0
+/**
+ * Stream is chosen by hashing the message number.
+ */
+#define STREAM_SEL_HASH 1
+/**
+ * Streams are used in proportion to their weights.
+ */
+#define STREAM_SEL_WEIGHTS 2
+
+/**
+ * Maximum number of stream weights.
+ */
+#define STREAM_MAX_WEIGHTS 64
+
+/**
+ * Selection of the outbound stream for the messages sent.
+ *
+ * Streams first - first+count-1 are used, the count is limited to the
+ * number of outbound streams negotiated for the association. The weights
+ * and the scheduler values are indexed by stream id, the weights of the
+ * streams before first are not used.
+ */
+struct stream_sel {
+        int mode; /**< STREAM_SEL_* */
+        uint16_t requested; /**< Number of streams requested, 0 if not used */
+        uint16_t first; /**< First stream to use */
+        uint16_t count; /**< Number of streams used, 0 until resolved */
+        sctp_assoc_t assoc_id; /**< Association the streams are resolved for */
+        uint16_t weight_count; /**< Number of weights given */
+        uint16_t value_count; /**< Number of scheduler values given */
+        uint16_t values[STREAM_MAX_WEIGHTS]; /**< Scheduler values for streams 0, 1, ... */
+        uint32_t seq; /**< Number of messages sent */
+        uint32_t weights[STREAM_MAX_WEIGHTS]; /**< Weights for streams 0, 1, ... */
+        int64_t current[STREAM_MAX_WEIGHTS]; /**< Smooth weighted round robin state */
+        uint64_t weight_sum; /**< Sum of the weights of the used streams */
+};
+
+int stream_sel_parse( struct stream_sel *sel, char *arg );
+int stream_sel_parse_values( struct stream_sel *sel, char *arg );
+int stream_sel_resolve( struct stream_sel *sel, int sock );
+uint16_t stream_sel_next( struct stream_sel *sel );
+
+/**
+ * Statistics of one inbound stream.
+ */
+struct stream_stats {
+        struct tput_stats tput; /**< Throughput of the stream */
+        struct histogram *lat_interval; /**< Delivery latency on current interval */
+        struct histogram *lat_total; /**< Delivery latency on whole run */
+        int seen; /**< 1 if data has been received on the stream */
+};
+
+/**
+ * Message delivered in parts, the key is the association and the stream
+ * as the parts of the messages of different associations may be
+ * interleaved.
+ */
+struct stream_partial {
+        sctp_assoc_t assoc_id; /**< Association the message is from */
+        uint16_t stream; /**< Stream the message is on */
+        uint64_t send_ns; /**< Send time of the message, 0 if unknown */
+};
+
+/**
+ * Per-stream statistics of the received data, indexed by stream id.
+ */
+struct stream_table {
+        struct stream_stats *streams; /**< The streams, NULL if not used */
+        uint32_t size; /**< Number of entries allocated */
+        struct stream_partial *partials; /**< Messages delivered in parts */
+        uint32_t partial_count; /**< Number of messages delivered in parts */
+        uint32_t partial_size; /**< Number of partials allocated */
+        uint64_t interval_ns; /**< Reporting interval, 0 for no reports */
+        uint64_t start_ns; /**< Time the measurement started */
+        uint64_t report_ns; /**< Time of the last report */
+};
+
+void stream_stats_init( struct stream_table *t, uint64_t interval_ns );
+void stream_stats_free( struct stream_table *t );
+void stream_stats_add( struct stream_table *t, sctp_assoc_t assoc_id,
+                uint16_t stream, uint8_t *buf, int len, int eor );
+void stream_stats_drop_assoc( struct stream_table *t, sctp_assoc_t assoc_id );
+void stream_stats_tick( struct stream_table *t, const char *label );
+void stream_stats_final( struct stream_table *t, const char *label );
+
+#endif /* _STREAMS_H_ */
@@ -0,0 +1,493 @@
+/**
+ * @file uring.c - io_uring based I/O engine.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/sctp.h>
+#include <poll.h>
+#include <liburing.h>
+
+#define DBG_MODULE_NAME DBG_MODULE_URING
+#include "defs.h"
+#include "debug.h"
+#include "common.h"
+#include "uring.h"
+
+/**
+ * Group id for the provided receive buffers.
+ */
+#define URING_BGID 1
+
+/**
+ * user_data for the multishot receive.
+ */
+#define URING_RECV_TAG UINT64_MAX
+
+/**
+ * user_data for the cancel request.
+ */
+#define URING_CANCEL_TAG (UINT64_MAX - 1)
+
+/**
+ * user_data for the poll on the watched fd.
+ */
+#define URING_WATCH_TAG (UINT64_MAX - 2)
+
+/**
+ * Number of attempts to wait for the requests to finish when the engine
+ * is stopped.
+ */
+#define URING_STOP_ROUNDS 10
+
+/**
+ * Buffer for message to send.
+ */
+struct uring_slot {
+        struct msghdr msg; /**< Message header for sendmsg */
+        struct iovec iov; /**< The data */
+        struct sockaddr_storage addr; /**< The destination */
+        uint8_t cbuf[SCTP_CMSG_SPACE]; /**< SCTP_SNDINFO */
+        uint8_t *data; /**< Copy of the data */
+};
+
+/**
+ * The io_uring engine.
+ *
+ * Messages are received with one multishot recvmsg request, the kernel
+ * picks the buffers from a ring of provided buffers registered with the
+ * ring. Messages to send are copied to send slots and submitted on next
+ * call to uring_next(), so all the sends queued meanwhile are submitted
+ * with one system call.
+ */
+struct uring_engine {
+        struct io_uring ring; /**< The io_uring */
+        struct io_uring_buf_ring *br; /**< Provided receive buffers */
+        uint8_t *rbufs; /**< Memory for the receive buffers */
+        size_t rbuf_size; /**< Size of one receive buffer */
+        unsigned int nbufs; /**< Number of receive buffers */
+        struct msghdr tmpl; /**< Layout of the multishot receive */
+        int sock; /**< Socket to receive from, -1 if none */
+        int armed; /**< 1 if the multishot receive is active */
+        int stopping; /**< 1 if the receive should not be re-armed */
+        struct uring_slot *slots; /**< Slots for the messages to send */
+        unsigned int *free_slots; /**< Stack of free slot indexes */
+        unsigned int nfree; /**< Number of free slots */
+        unsigned int depth; /**< Number of send slots */
+        size_t buf_len; /**< Maximum size of one message */
+};
+
+/**
+ * Create new io_uring engine.
+ *
+ * @param depth Number of sends and receive buffers in flight.
+ * @param buf_len Maximum size of the messages.
+ * @return Pointer to the engine, NULL on error (errno is set).
+ */
+struct uring_engine *uring_create( unsigned int depth, size_t buf_len )
+{
+        struct uring_engine *eng;
+        unsigned int i;
+        int ret;
+
+        eng = mem_zalloc( sizeof(*eng));
+        eng->sock = -1;
+        eng->depth = depth;
+        eng->buf_len = buf_len;
+
+        ret = io_uring_queue_init( 2 * depth, &eng->ring, 0 );
+        if ( ret < 0 ) {
+                mem_free( eng );
+                errno = -ret;
+                return NULL;
+        }
+
+        /* the number of provided buffers must be power of two */
+        for ( eng->nbufs = 1; eng->nbufs < depth; eng->nbufs <<= 1 )
+                ;
+        eng->br = io_uring_setup_buf_ring( &eng->ring, eng->nbufs, 
+                        URING_BGID, 0, &ret );
+        if ( eng->br == NULL ) {
+                io_uring_queue_exit( &eng->ring );
+                mem_free( eng );
+                errno = -ret;
+                return NULL;
+        }
+
+        eng->tmpl.msg_namelen = sizeof(struct sockaddr_storage);
+        eng->tmpl.msg_controllen = SCTP_CMSG_SPACE;
+        eng->rbuf_size = sizeof(struct io_uring_recvmsg_out) + 
+                eng->tmpl.msg_namelen + eng->tmpl.msg_controllen + buf_len;
+        eng->rbufs = mem_alloc( eng->nbufs * eng->rbuf_size );
+        for ( i = 0; i < eng->nbufs; i++ ) {
+                io_uring_buf_ring_add( eng->br, eng->rbufs + i * eng->rbuf_size,
+                                eng->rbuf_size, i, 
+                                io_uring_buf_ring_mask( eng->nbufs ), i );
+        }
+        io_uring_buf_ring_advance( eng->br, eng->nbufs );
+
+        eng->slots = mem_zalloc( depth * sizeof(*eng->slots));
+        eng->free_slots = mem_alloc( depth * sizeof(*eng->free_slots));
+        for ( i = 0; i < depth; i++ ) {
+                eng->slots[i].data = mem_alloc( buf_len );
+                eng->free_slots[i] = i;
+        }
+        eng->nfree = depth;
+
+        TRACE("io_uring engine with depth %u and %u receive buffers\n", 
+                        depth, eng->nbufs );
+        return eng;
+}
+
+/**
+ * Release the engine. The engine should be stopped.
+ *
+ * @param eng Pointer to the engine.
+ */
+void uring_delete( struct uring_engine *eng )
+{
+        unsigned int i;
+
+        if ( eng == NULL )
+                return;
+
+        io_uring_free_buf_ring( &eng->ring, eng->br, eng->nbufs, URING_BGID );
+        io_uring_queue_exit( &eng->ring );
+        for ( i = 0; i < eng->depth; i++ ) 
+                mem_free( eng->slots[i].data );
+        mem_free( eng->slots );
+        mem_free( eng->free_slots );
+        mem_free( eng->rbufs );
+        mem_free( eng );
+}
+
+/**
+ * Queue the multishot receive request.
+ *
+ * @param eng Pointer to the engine.
+ * @return -1 if the submission queue is full, 0 on success.
+ */
+static int arm_recv( struct uring_engine *eng )
+{
+        struct io_uring_sqe *sqe;
+
+        sqe = io_uring_get_sqe( &eng->ring );
+        if ( sqe == NULL ) 
+                return -1;
+
+        io_uring_prep_recvmsg_multishot( sqe, eng->sock, &eng->tmpl, 0 );
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BGID;
+        io_uring_sqe_set_data64( sqe, URING_RECV_TAG );
+        eng->armed = 1;
+        return 0;
+}
+
+/**
+ * Start receiving messages from the socket.
+ *
+ * @param eng Pointer to the engine.
+ * @param sock The socket to receive from.
+ * @return -1 on error, 0 on success.
+ */
+int uring_recv_start( struct uring_engine *eng, int sock )
+{
+        eng->sock = sock;
+        eng->stopping = 0;
+        if ( arm_recv( eng ) < 0 ) {
+                errno = EBUSY;
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Queue message to send. The data is copied and the message is submitted
+ * on next call to uring_next().
+ *
+ * @param eng Pointer to the engine.
+ * @param sock The socket to send to.
+ * @param dst Destination for the message, NULL if the socket is connected.
+ * @param dst_len Length of the destination address.
+ * @param data The data to send.
+ * @param len Number of bytes to send.
+ * @param ppid PPID for the message.
+ * @param streamno Stream to send the message to.
+ * @param context Context of the message, reported back if sending fails.
+ * @return -1 if there are no free send slots (errno is ENOBUFS) or the
+ * message is too large (EMSGSIZE), 0 on success.
+ */
+int uring_send( struct uring_engine *eng, int sock, struct sockaddr *dst,
+                socklen_t dst_len, uint8_t *data, size_t len, uint32_t ppid,
+                uint16_t streamno, uint32_t context )
+{
+        struct io_uring_sqe *sqe;
+        struct uring_slot *slot;
+        unsigned int idx;
+
+        if ( len > eng->buf_len ) {
+                errno = EMSGSIZE;
+                return -1;
+        }
+        if ( eng->nfree == 0 ) {
+                errno = ENOBUFS;
+                return -1;
+        }
+        sqe = io_uring_get_sqe( &eng->ring );
+        if ( sqe == NULL ) {
+                errno = ENOBUFS;
+                return -1;
+        }
+        idx = eng->free_slots[--eng->nfree];
+        slot = &eng->slots[idx];
+
+        memset( &slot->msg, 0, sizeof(slot->msg));
+        memcpy( slot->data, data, len );
+        slot->iov.iov_base = slot->data;
+        slot->iov.iov_len = len;
+        slot->msg.msg_iov = &slot->iov;
+        slot->msg.msg_iovlen = 1;
+        if ( dst != NULL ) {
+                memcpy( &slot->addr, dst, dst_len );
+                slot->msg.msg_name = &slot->addr;
+                slot->msg.msg_namelen = dst_len;
+        }
+        set_sndinfo_cmsg( &slot->msg, slot->cbuf, ppid, streamno, context );
+
+        io_uring_prep_sendmsg( sqe, sock, &slot->msg, 0 );
+        io_uring_sqe_set_data64( sqe, idx );
+        return 0;
+}
+
+/**
+ * Get the number of sends not yet completed.
+ *
+ * @param eng Pointer to the engine.
+ * @return Number of sends queued or in flight.
+ */
+unsigned int uring_sends_pending( struct uring_engine *eng )
+{
+        return eng->depth - eng->nfree;
+}
+
+/**
+ * Parse the received message from the provided buffer.
+ *
+ * @param eng Pointer to the engine.
+ * @param ev The event to fill.
+ * @param res Result of the receive.
+ * @param cflags Flags of the completion.
+ * @return -1 if the message is invalid, 0 on success.
+ */
+static int parse_recv( struct uring_engine *eng, struct uring_event *ev, 
+                int res, unsigned int cflags )
+{
+        struct io_uring_recvmsg_out *out;
+        struct cmsghdr *cmsg;
+        uint8_t *buf;
+
+        ev->bid = cflags >> IORING_CQE_BUFFER_SHIFT;
+        buf = eng->rbufs + ev->bid * eng->rbuf_size;
+        out = io_uring_recvmsg_validate( buf, res, &eng->tmpl );
+        if ( out == NULL ) 
+                return -1;
+
+        ev->data = io_uring_recvmsg_payload( out, &eng->tmpl );
+        ev->len = io_uring_recvmsg_payload_length( out, res, &eng->tmpl );
+        ev->flags = out->flags;
+        ev->peerlen = out->namelen < sizeof(ev->peer) ? 
+                out->namelen : sizeof(ev->peer);
+        memcpy( &ev->peer, io_uring_recvmsg_name( out ), ev->peerlen );
+        for ( cmsg = io_uring_recvmsg_cmsg_firsthdr( out, &eng->tmpl ); 
+                        cmsg != NULL; 
+                        cmsg = io_uring_recvmsg_cmsg_nexthdr( out, &eng->tmpl, cmsg ))
+                get_rcvinfo_cmsg( cmsg, &ev->info );
+
+        return 0;
+}
+
+/**
+ * Submit the queued requests and wait for next completion.
+ *
+ * For received messages, uring_done() should be called once the data is
+ * no longer needed.
+ *
+ * @param eng Pointer to the engine.
+ * @param ev Pointer to the event where the completion is stored.
+ * @param timeout_ns Maximum number of nanoseconds to wait, 
+ * URING_WAIT_FOREVER for no timeout.
+ * @return 1 if completion was returned, 0 on timeout or if the fd given to
+ * uring_watch() became readable, -1 on error (errno is set).
+ */
+int uring_next( struct uring_engine *eng, struct uring_event *ev, 
+                uint64_t timeout_ns )
+{
+        struct io_uring_cqe *cqe;
+        struct __kernel_timespec ts;
+        uint64_t tag;
+        unsigned int cflags;
+        int ret, res;
+
+        while ( 1 ) {
+                if ( !eng->armed && !eng->stopping && eng->sock >= 0 ) 
+                        arm_recv( eng );
+
+                ts.tv_sec = timeout_ns / NSEC_PER_SEC;
+                ts.tv_nsec = timeout_ns % NSEC_PER_SEC;
+                ret = io_uring_submit_and_wait_timeout( &eng->ring, &cqe, 1, 
+                                timeout_ns == URING_WAIT_FOREVER ? NULL : &ts,
+                                NULL );
+                if ( ret == -ETIME ) {
+                        return 0;
+                } else if ( ret < 0 ) {
+                        errno = -ret;
+                        return -1;
+                }
+                tag = io_uring_cqe_get_data64( cqe );
+                res = cqe->res;
+                cflags = cqe->flags;
+                io_uring_cqe_seen( &eng->ring, cqe );
+
+                memset( ev, 0, sizeof(*ev));
+                ev->res = res;
+                if ( tag == URING_CANCEL_TAG ) {
+                        continue;
+                } else if ( tag == URING_WATCH_TAG ) {
+                        TRACE("Watched fd is readable\n");
+                        return 0;
+                } else if ( tag != URING_RECV_TAG ) {
+                        eng->free_slots[eng->nfree++] = (unsigned int)tag;
+                        ev->type = URING_EV_SEND;
+                        return 1;
+                }
+
+                ev->type = URING_EV_RECV;
+                if ( !(cflags & IORING_CQE_F_MORE) ) 
+                        eng->armed = 0;
+                if ( res == -ENOBUFS ) {
+                        TRACE("Out of receive buffers, re-arming\n");
+                        continue;
+                } else if ( res == -ECANCELED && eng->stopping ) {
+                        continue;
+                } else if ( res < 0 ) {
+                        return 1;
+                } else if ( !(cflags & IORING_CQE_F_BUFFER) ) {
+                        /* the receive ended without data */
+                        ev->res = 0;
+                        return 1;
+                }
+                if ( parse_recv( eng, ev, res, cflags ) < 0 ) {
+                        WARN("Invalid message received\n");
+                        uring_done( eng, ev );
+                        continue;
+                }
+                return 1;
+        }
+}
+
+/**
+ * Make uring_next() return once the fd becomes readable. 
+ *
+ * This is used to wait for the stop request without timeouts. The fd is
+ * watched only once, it is expected to stay readable.
+ *
+ * @param eng Pointer to the engine.
+ * @param fd The fd to watch.
+ * @return -1 if the poll could not be queued, 0 on success.
+ */
+int uring_watch( struct uring_engine *eng, int fd )
+{
+        struct io_uring_sqe *sqe;
+
+        sqe = io_uring_get_sqe( &eng->ring );
+        if ( sqe == NULL ) {
+                errno = ENOBUFS;
+                return -1;
+        }
+        io_uring_prep_poll_add( sqe, fd, POLLIN );
+        io_uring_sqe_set_data64( sqe, URING_WATCH_TAG );
+        return 0;
+}
+
+/**
+ * Return the buffer of received message to the engine.
+ *
+ * @param eng Pointer to the engine.
+ * @param ev The receive event.
+ */
+void uring_done( struct uring_engine *eng, struct uring_event *ev )
+{
+        if ( ev->type != URING_EV_RECV || ev->res <= 0 )
+                return;
+
+        io_uring_buf_ring_add( eng->br, eng->rbufs + ev->bid * eng->rbuf_size,
+                        eng->rbuf_size, ev->bid, 
+                        io_uring_buf_ring_mask( eng->nbufs ), 0 );
+        io_uring_buf_ring_advance( eng->br, 1 );
+        ev->res = 0;
+}
+
+/**
+ * Cancel the receive and wait for the requests in flight to finish. The
+ * engine can be started again with uring_recv_start().
+ *
+ * @param eng Pointer to the engine.
+ */
+void uring_stop( struct uring_engine *eng )
+{
+        struct io_uring_sqe *sqe;
+        struct uring_event ev;
+        int rounds = 0;
+
+        eng->stopping = 1;
+        if ( eng->armed ) {
+                sqe = io_uring_get_sqe( &eng->ring );
+                if ( sqe != NULL ) {
+                        io_uring_prep_cancel64( sqe, URING_RECV_TAG, 0 );
+                        io_uring_sqe_set_data64( sqe, URING_CANCEL_TAG );
+                }
+        }
+        while ( (eng->armed || uring_sends_pending( eng ) > 0) &&
+                        rounds < URING_STOP_ROUNDS ) {
+                if ( uring_next( eng, &ev, NSEC_PER_SEC / 10 ) <= 0 ) {
+                        rounds++;
+                        continue;
+                }
+                uring_done( eng, &ev );
+        }
+        eng->sock = -1;
+}
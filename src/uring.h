@@ -0,0 +1,84 @@
+/**
+ * @file uring.h - io_uring based I/O engine.
+ *
+ * Copyright (c) 2009 - 2026, J. Taimisto <jtaimisto@gmail.com>
+ * All rights reserved.
+ *  
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: 
+ *
+ *     - Redistributions of source code must retain the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer.
+ *     - Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _URING_H_
+#define _URING_H_
+
+/**
+ * Default number of requests in flight on the engine.
+ */
+#define URING_DEFAULT_DEPTH 64
+
+/**
+ * Type of the completion returned by uring_next().
+ */
+enum uring_event_type {
+        URING_EV_RECV = 0, /**< Message received */
+        URING_EV_SEND /**< Send completed */
+};
+
+/**
+ * Completion returned by uring_next().
+ */
+struct uring_event {
+        enum uring_event_type type; /**< Type of the completion */
+        int res; /**< Result of the operation, -errno on error */
+        uint8_t *data; /**< Received data (URING_EV_RECV) */
+        size_t len; /**< Number of bytes received (URING_EV_RECV) */
+        int flags; /**< Flags of the received message (URING_EV_RECV) */
+        struct sockaddr_storage peer; /**< Sender of the message */
+        socklen_t peerlen; /**< Length of the sender address */
+        struct sctp_sndrcvinfo info; /**< SCTP information of the message */
+        uint16_t bid; /**< Buffer holding the data */
+};
+
+/**
+ * Timeout for uring_next() to wait without timeout.
+ */
+#define URING_WAIT_FOREVER UINT64_MAX
+
+struct uring_engine;
+
+struct uring_engine *uring_create( unsigned int depth, size_t buf_len );
+void uring_delete( struct uring_engine *eng );
+int uring_recv_start( struct uring_engine *eng, int sock );
+int uring_send( struct uring_engine *eng, int sock, struct sockaddr *dst,
+                socklen_t dst_len, uint8_t *data, size_t len, uint32_t ppid,
+                uint16_t streamno, uint32_t context );
+unsigned int uring_sends_pending( struct uring_engine *eng );
+int uring_next( struct uring_engine *eng, struct uring_event *ev, 
+                uint64_t timeout_ns );
+int uring_watch( struct uring_engine *eng, int fd );
+void uring_done( struct uring_engine *eng, struct uring_event *ev );
+void uring_stop( struct uring_engine *eng );
+
+#endif /* _URING_H_ */